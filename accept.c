@@ -0,0 +1,133 @@
+/**
+ * @file accept.c
+ * @brief Acceptable master table (IEEE 1588-2008 17.6).
+ *
+ * With ptpd_opts.acceptable_master_only set, the Announce, Sync, Follow_Up
+ * and Delay_Resp messages of a master that is not in the table are dropped
+ * in handle_msg(), before the BMC, the servo or any other module sees them.
+ * An entry names a clock identity and optionally the port number and IP
+ * address it must come from, so a device copying a grandmaster's identity
+ * from elsewhere on the network is rejected too.
+ *
+ * The check runs for every message of every master on the segment, so the
+ * table is indexed by an open addressing hash of the clock identity, built
+ * once from the options. A lookup touches one or two slots whatever the
+ * size of the table.
+ */
+
+#include "../ptpd.h"
+
+extern ptpd_opts ptp_opts;
+
+#define ACCEPT_HASH_SIZE    (2 * PTP_MAX_ACCEPTABLE_MASTERS) // Keeps the load factor at 1/2 or below
+#define ACCEPT_HASH_MASK    (ACCEPT_HASH_SIZE - 1)
+
+_Static_assert((ACCEPT_HASH_SIZE & ACCEPT_HASH_MASK) == 0, "PTP_MAX_ACCEPTABLE_MASTERS must be a power of two");
+
+// Table index + 1 of the entry in each slot, 0 for an empty slot
+PTP_ARENA static uint8_t hash_table[ACCEPT_HASH_SIZE];
+const uint32_t accept_arena_bytes = sizeof(hash_table);
+
+static uint32_t accepted;
+static uint32_t rejected;
+static PortIdentity last_rejected;
+
+
+// --- Helper Functions ---
+
+/**
+ * @brief Hash a clock identity to its first slot.
+ *
+ * The last bytes of an EUI-64 derived identity are the serial part that
+ * differs between devices of one vendor; the first ones are the vendor's.
+ */
+PTP_LMB_TEXT static uint32_t hash_identity(const uint8_t *id)
+{
+    uint32_t h = ((uint32_t)id[5] << 16) | ((uint32_t)id[6] << 8) | id[7];
+
+    h ^= ((uint32_t)id[0] << 16) | ((uint32_t)id[1] << 8) | id[2];
+    h ^= h >> 11;
+    h ^= h >> 5;
+    return h & ACCEPT_HASH_MASK;
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Build the hash index from ptpd_opts.acceptable_masters.
+ */
+void accept_init(void)
+{
+    uint32_t slot;
+    uint8_t i, n;
+
+    memset(hash_table, 0, sizeof(hash_table));
+    accepted = 0;
+    rejected = 0;
+
+    n = (ptp_opts.num_acceptable_masters > PTP_MAX_ACCEPTABLE_MASTERS) ?
+        PTP_MAX_ACCEPTABLE_MASTERS : ptp_opts.num_acceptable_masters;
+    for (i = 0; i < n; ++i) {
+        slot = hash_identity(ptp_opts.acceptable_masters[i].clock_identity);
+        while (hash_table[slot] != 0) {
+            slot = (slot + 1) & ACCEPT_HASH_MASK;
+        }
+        hash_table[slot] = i + 1;
+    }
+
+    if (ptp_opts.acceptable_master_only) {
+        xil_printf("PTPd: Acceptable master table: %d entries\r\n", n);
+        if (n == 0) {
+            xil_printf("PTPd: WARNING: Acceptable master table is empty, every master is rejected\r\n");
+        }
+    }
+}
+
+/**
+ * @brief Check the sender of a master message against the table.
+ *
+ * Several entries may share a clock identity (one per port or address);
+ * the probe continues until one matches or an empty slot ends the chain.
+ *
+ * @param header The header of the received message.
+ * @param addr The sender's address (NULL for PTP over Ethernet).
+ * @return TRUE if the master is acceptable, FALSE to drop the message.
+ */
+PTP_LMB_TEXT bool accept_master(const PtpHeader *header, const ip_addr_t *addr)
+{
+    const uint8_t *id = header->sourcePortIdentity.clockIdentity;
+    const ptp_acceptable_master_t *e;
+    uint32_t slot = hash_identity(id);
+    uint32_t probes;
+
+    for (probes = 0; probes < ACCEPT_HASH_SIZE && hash_table[slot] != 0; ++probes) {
+        e = &ptp_opts.acceptable_masters[hash_table[slot] - 1];
+        if (memcmp(e->clock_identity, id, 8) == 0 &&
+            (e->port_number == PTP_ACCEPT_ANY_PORT || e->port_number == header->sourcePortIdentity.portNumber) &&
+            (addr == NULL || ip_addr_isany_val(e->address) || ip_addr_cmp(&e->address, addr))) {
+            accepted++;
+            return TRUE;
+        }
+        slot = (slot + 1) & ACCEPT_HASH_MASK;
+    }
+
+    rejected++;
+    last_rejected = header->sourcePortIdentity;
+    return FALSE;
+}
+
+/**
+ * @brief Print the acceptance counters and the last master rejected.
+ */
+void accept_print_stats(void)
+{
+    const uint8_t *id = last_rejected.clockIdentity;
+
+    xil_printf("PTPd: Acceptable masters: %d messages accepted, %d rejected", accepted, rejected);
+    if (rejected != 0) {
+        xil_printf(", last from %02x%02x%02x%02x%02x%02x%02x%02x port %d",
+            id[0], id[1], id[2], id[3], id[4], id[5], id[6], id[7], last_rejected.portNumber);
+    }
+    xil_printf("\r\n");
+}
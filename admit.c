@@ -0,0 +1,217 @@
+/**
+ * @file admit.c
+ * @brief Delay_Req admission control on the master.
+ *
+ * Every Delay_Req a master answers costs a timestamped Delay_Resp, so one
+ * slave sending far faster than logMinDelayReqInterval can crowd out the
+ * Syncs of the whole segment. Each source (PortIdentity, and IP address
+ * when PTP runs over UDP) gets a token bucket that refills at twice the
+ * rate it is allowed, the headroom the randomized Delay_Req interval of
+ * IEEE 1588 9.5.11.2 needs, and holds a burst of ADMIT_BURST requests. A
+ * second bucket caps the Delay_Reqs answered per second over all sources,
+ * so a flood of spoofed identities is bounded as well.
+ *
+ * The source table has PTP_MAX_DELAY_REQ_SOURCES records; when it is full
+ * the record idle the longest is reused.
+ */
+
+#include "../ptpd.h"
+
+#ifndef PTP_SLAVE_ONLY
+
+extern ptpd_opts ptp_opts;
+
+#define ADMIT_BURST         4   // Delay_Reqs a source may send back to back
+#define ADMIT_RATE_FACTOR   2   // Allowed rate over the nominal one
+#define CREDIT_SHIFT        8   // Bucket credit in 1/256 ticks
+#define ADMIT_MAX_LOG_INTERVAL 8 // Longer intervals are limited as this one, keeps the credit in 32 bits
+
+typedef struct {
+    bool in_use;
+    bool warned;             // Rate limit reported once for this source
+    PortIdentity port_identity;
+    ip_addr_t address;       // Zero for PTP over Ethernet
+    uint32_t last_tick;      // When the credit was last brought up to date
+    int32_t credit;          // Bucket level (1/256 ticks)
+    uint32_t admitted;
+    uint32_t dropped;
+} admit_source_t;
+
+PTP_ARENA static admit_source_t sources[PTP_MAX_DELAY_REQ_SOURCES];
+const uint32_t admit_arena_bytes = sizeof(sources);
+
+static uint32_t admit_ticks;     // Protocol ticks since admit_init()
+static int32_t global_credit;    // Bucket level of the aggregate limit (1/256 ticks)
+static uint32_t admitted_total;
+static uint32_t dropped_source;  // Over the source's own limit
+static uint32_t dropped_global;  // Over the aggregate limit
+static uint32_t evictions;
+
+
+// --- Helper Functions ---
+
+static bool same_port(const PortIdentity *a, const PortIdentity *b)
+{
+    return memcmp(a->clockIdentity, b->clockIdentity, 8) == 0 && a->portNumber == b->portNumber;
+}
+
+/**
+ * @brief Find the record of a source, taking a free or the stalest one.
+ * @param header The header of the Delay_Req.
+ * @param addr The sender's address (NULL for PTP over Ethernet).
+ * @param burst Credit a new record starts with.
+ * @return The source record.
+ */
+static admit_source_t *find_source(const PtpHeader *header, const ip_addr_t *addr, int32_t burst)
+{
+    admit_source_t *slot = NULL;
+    int i;
+
+    for (i = 0; i < PTP_MAX_DELAY_REQ_SOURCES; ++i) {
+        admit_source_t *s = &sources[i];
+
+        if (!s->in_use) {
+            if (slot == NULL || slot->in_use) {
+                slot = s;
+            }
+            continue;
+        }
+        if (same_port(&s->port_identity, &header->sourcePortIdentity) &&
+            (addr == NULL || ip_addr_cmp(&s->address, addr))) {
+            return s;
+        }
+        if (slot == NULL || (slot->in_use && admit_ticks - s->last_tick > admit_ticks - slot->last_tick)) {
+            slot = s;
+        }
+    }
+
+    if (slot->in_use) {
+        evictions++;
+    }
+    memset(slot, 0, sizeof(*slot));
+    slot->in_use = TRUE;
+    slot->port_identity = header->sourcePortIdentity;
+    if (addr != NULL) {
+        ip_addr_copy(slot->address, *addr);
+    }
+    slot->last_tick = admit_ticks;
+    slot->credit = burst;
+    return slot;
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Forget all sources and reset the counters.
+ */
+void admit_init(void)
+{
+    memset(sources, 0, sizeof(sources));
+    admit_ticks = 0;
+    global_credit = PTP_TICK_RATE_HZ << CREDIT_SHIFT;
+    admitted_total = 0;
+    dropped_source = 0;
+    dropped_global = 0;
+    evictions = 0;
+}
+
+/**
+ * @brief Refill the aggregate bucket, called every protocol tick.
+ */
+void admit_tick(void)
+{
+    admit_ticks++;
+    global_credit += 1 << CREDIT_SHIFT;
+    if (global_credit > (PTP_TICK_RATE_HZ << CREDIT_SHIFT)) {
+        global_credit = PTP_TICK_RATE_HZ << CREDIT_SHIFT; // One second's worth of requests
+    }
+}
+
+/**
+ * @brief Decide whether a Delay_Req is answered.
+ * @param header The header of the Delay_Req.
+ * @param addr The sender's address (NULL for PTP over Ethernet).
+ * @param log_interval The logMinDelayReqInterval the sender must keep.
+ * @return TRUE to send the Delay_Resp, FALSE to drop the request.
+ */
+bool admit_delay_req(const PtpHeader *header, const ip_addr_t *addr, int8_t log_interval)
+{
+    int32_t cost;
+    int32_t global_cost;
+    uint32_t elapsed;
+    admit_source_t *s;
+
+    if (!ptp_opts.delay_req_limit) {
+        return TRUE;
+    }
+
+    if (log_interval > ADMIT_MAX_LOG_INTERVAL) {
+        log_interval = ADMIT_MAX_LOG_INTERVAL;
+    }
+    cost = (int32_t)(timer_log_interval_ticks(log_interval) << CREDIT_SHIFT) / ADMIT_RATE_FACTOR;
+
+    s = find_source(header, addr, cost * ADMIT_BURST);
+    elapsed = admit_ticks - s->last_tick;
+    s->last_tick = admit_ticks;
+    if (elapsed >= (uint32_t)(cost * ADMIT_BURST) >> CREDIT_SHIFT) {
+        s->credit = cost * ADMIT_BURST; // Idle long enough to fill the bucket
+    } else {
+        s->credit += (int32_t)elapsed << CREDIT_SHIFT;
+        if (s->credit > cost * ADMIT_BURST) {
+            s->credit = cost * ADMIT_BURST;
+        }
+    }
+
+    if (s->credit < cost) {
+        s->dropped++;
+        dropped_source++;
+        if (!s->warned) {
+            s->warned = TRUE;
+            xil_printf("PTPd: WARNING: Delay_Req from %02x%02x%02x port %d exceeds 2^%d s, rate limited\r\n",
+                s->port_identity.clockIdentity[5], s->port_identity.clockIdentity[6],
+                s->port_identity.clockIdentity[7], s->port_identity.portNumber, log_interval);
+        }
+        return FALSE;
+    }
+
+    if (ptp_opts.delay_req_max_rate > 0) {
+        global_cost = (PTP_TICK_RATE_HZ << CREDIT_SHIFT) / ptp_opts.delay_req_max_rate;
+        if (global_credit < global_cost) {
+            dropped_global++;
+            return FALSE;
+        }
+        global_credit -= global_cost;
+    }
+
+    s->credit -= cost;
+    s->admitted++;
+    admitted_total++;
+    return TRUE;
+}
+
+/**
+ * @brief Print the admission counters and every source that was limited.
+ */
+void admit_print_stats(void)
+{
+    int i;
+
+    xil_printf("PTPd: Delay_Req admission: %d answered, %d over source limit, %d over %d/s, %d evictions\r\n",
+        admitted_total, dropped_source, dropped_global, ptp_opts.delay_req_max_rate, evictions);
+
+    for (i = 0; i < PTP_MAX_DELAY_REQ_SOURCES; ++i) {
+        const admit_source_t *s = &sources[i];
+
+        if (!s->in_use || s->dropped == 0) {
+            continue;
+        }
+        xil_printf("PTPd: Delay_Req admission: %02x%02x%02x%02x%02x%02x%02x%02x port %d: %d answered, %d dropped\r\n",
+            s->port_identity.clockIdentity[0], s->port_identity.clockIdentity[1], s->port_identity.clockIdentity[2],
+            s->port_identity.clockIdentity[3], s->port_identity.clockIdentity[4], s->port_identity.clockIdentity[5],
+            s->port_identity.clockIdentity[6], s->port_identity.clockIdentity[7], s->port_identity.portNumber,
+            s->admitted, s->dropped);
+    }
+}
+
+#endif /* PTP_SLAVE_ONLY */
@@ -0,0 +1,426 @@
+/**
+ * @file auth.c
+ * @brief AUTHENTICATION TLV with HMAC-SHA256 (IEEE 1588-2019 16.14).
+ *
+ * With ptpd_opts.auth set, every message sent carries an AUTHENTICATION
+ * TLV as its last TLV, with the Integrity Check Value of one pre-shared
+ * key, and every message received must carry a valid one. Only immediate
+ * security processing is supported: secParamIndicator is 0, and there is
+ * no disclosed key, sequence number or RES field.
+ *
+ * The ICV is HMAC-SHA256 over the whole message up to the ICV, truncated
+ * to the key's icv_len, with the correctionField taken as zero so that
+ * transparent clocks do not break it. The key's inner and outer hash
+ * states are computed once in auth_init(), which saves two of the five
+ * SHA-256 blocks of a short message.
+ *
+ * Signing happens before a message enters lwIP, so an event message's
+ * transmit timestamp, taken at the MAC, is not affected. Syncs are always
+ * two-step here, so nothing under the ICV changes after signing.
+ * Verification runs in handle_msg(), on a message whose receive time the
+ * netif input hook took before lwIP saw the frame, and before any sample
+ * of it reaches the servo. auth_benchmark() prints the cost of both on
+ * the target; main() runs it in PTP_AUTH_BENCHMARK builds.
+ */
+
+#include "../ptpd.h"
+
+extern ptpd_opts ptp_opts;
+
+#define TLV_HEADER_LEN      4
+#define TLV_AUTHENTICATION  0x8009
+#define AUTH_FIXED_LEN      6   // SPP, secParamIndicator, keyID
+#define SHA256_BLOCK        64
+#define SHA256_DIGEST       32
+
+// Precomputed HMAC state of one key
+typedef struct {
+    uint32_t inner[8];  // SHA-256 state after (key ^ ipad)
+    uint32_t outer[8];  // SHA-256 state after (key ^ opad)
+} auth_key_state_t;
+
+typedef struct {
+    uint32_t h[8];
+    uint8_t block[SHA256_BLOCK];
+    uint32_t fill;      // Bytes waiting in block
+    uint32_t length;    // Bytes hashed so far
+} sha256_ctx_t;
+
+PTP_ARENA static auth_key_state_t key_states[PTP_MAX_AUTH_KEYS];
+const uint32_t auth_arena_bytes = sizeof(key_states);
+
+static int tx_key = -1;         // Index of the signing key in ptp_opts.auth_keys
+static uint32_t verified;
+static uint32_t missing;        // No AUTHENTICATION TLV, or not the last TLV
+static uint32_t unknown_key;    // keyID, SPP, ICV length or parameters not ours
+static uint32_t bad_icv;
+
+// Length of the message body, where the TLVs start, per messageType
+static const uint8_t body_len[16] = {
+    44, 44, 54, 54, 0, 0, 0, 0,     // Sync, Delay_Req, Pdelay_Req, Pdelay_Resp
+    44, 54, 54, 64, 44, 48, 0, 0    // Follow_Up, Delay_Resp, Pdelay_Resp_Follow_Up, Announce, Signaling, Management
+};
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+
+// --- SHA-256 (FIPS 180-4) ---
+
+#define ROTR(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_compress(uint32_t h[8], const uint8_t *block)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, hh, t1, t2;
+    int i;
+
+    for (i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) |
+               ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+    }
+    for (i = 16; i < 64; ++i) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3];
+    e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+    for (i = 0; i < 64; ++i) {
+        t1 = hh + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        hh = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+/**
+ * @brief Continue a hash from a precomputed state that covered one block.
+ */
+static void sha256_resume(sha256_ctx_t *ctx, const uint32_t state[8])
+{
+    memcpy(ctx->h, state, sizeof(ctx->h));
+    ctx->fill = 0;
+    ctx->length = SHA256_BLOCK;
+}
+
+static void sha256_update(sha256_ctx_t *ctx, const uint8_t *data, uint32_t len)
+{
+    uint32_t n;
+
+    ctx->length += len;
+    while (len > 0) {
+        n = SHA256_BLOCK - ctx->fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(ctx->block + ctx->fill, data, n);
+        ctx->fill += n;
+        data += n;
+        len -= n;
+        if (ctx->fill == SHA256_BLOCK) {
+            sha256_compress(ctx->h, ctx->block);
+            ctx->fill = 0;
+        }
+    }
+}
+
+static void sha256_final(sha256_ctx_t *ctx, uint8_t *digest)
+{
+    uint32_t bits = ctx->length * 8;
+    int i;
+
+    ctx->block[ctx->fill++] = 0x80;
+    if (ctx->fill > SHA256_BLOCK - 8) {
+        memset(ctx->block + ctx->fill, 0, SHA256_BLOCK - ctx->fill);
+        sha256_compress(ctx->h, ctx->block);
+        ctx->fill = 0;
+    }
+    // Messages here are far below 2^29 bytes, the upper length word is 0
+    memset(ctx->block + ctx->fill, 0, SHA256_BLOCK - 4 - ctx->fill);
+    ctx->block[60] = (uint8_t)(bits >> 24);
+    ctx->block[61] = (uint8_t)(bits >> 16);
+    ctx->block[62] = (uint8_t)(bits >> 8);
+    ctx->block[63] = (uint8_t)bits;
+    sha256_compress(ctx->h, ctx->block);
+
+    for (i = 0; i < 8; ++i) {
+        digest[4 * i] = (uint8_t)(ctx->h[i] >> 24);
+        digest[4 * i + 1] = (uint8_t)(ctx->h[i] >> 16);
+        digest[4 * i + 2] = (uint8_t)(ctx->h[i] >> 8);
+        digest[4 * i + 3] = (uint8_t)ctx->h[i];
+    }
+}
+
+
+// --- Helper Functions ---
+
+/**
+ * @brief HMAC-SHA256 of a message, with its correctionField taken as zero.
+ * @param key The precomputed key state.
+ * @param msg The message, from the PTP header up to the ICV.
+ * @param len Its length (at least the 34 byte header).
+ * @param mac Receives the 32 byte HMAC.
+ */
+static void auth_hmac(const auth_key_state_t *key, const uint8_t *msg, int len, uint8_t *mac)
+{
+    static const uint8_t zero_correction[8] = { 0 };
+    uint8_t inner[SHA256_DIGEST];
+    sha256_ctx_t ctx;
+
+    sha256_resume(&ctx, key->inner);
+    sha256_update(&ctx, msg, 8);
+    sha256_update(&ctx, zero_correction, sizeof(zero_correction));
+    sha256_update(&ctx, msg + 16, (uint32_t)(len - 16));
+    sha256_final(&ctx, inner);
+
+    sha256_resume(&ctx, key->outer);
+    sha256_update(&ctx, inner, sizeof(inner));
+    sha256_final(&ctx, mac);
+}
+
+/**
+ * @brief Find a key of the table by its keyID.
+ * @return The table index, or -1 if the key is not configured.
+ */
+static int find_key(uint32_t key_id)
+{
+    int i;
+
+    for (i = 0; i < ptp_opts.num_auth_keys && i < PTP_MAX_AUTH_KEYS; ++i) {
+        if (ptp_opts.auth_keys[i].key_id == key_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Precompute the HMAC state of every key and pick the signing key.
+ * @return TRUE if authentication is off or ready, FALSE on a bad key table.
+ */
+bool auth_init(void)
+{
+    uint8_t pad[SHA256_BLOCK];
+    int i, j;
+
+    verified = missing = unknown_key = bad_icv = 0;
+    tx_key = -1;
+    if (!ptp_opts.auth) {
+        return TRUE;
+    }
+
+    for (i = 0; i < ptp_opts.num_auth_keys && i < PTP_MAX_AUTH_KEYS; ++i) {
+        const ptp_auth_key_t *k = &ptp_opts.auth_keys[i];
+
+        if (k->key_len > PTP_AUTH_KEY_LEN || k->icv_len < 1 || k->icv_len > SHA256_DIGEST) {
+            xil_printf("PTPd: ERROR: Authentication key %d is malformed\r\n", k->key_id);
+            return FALSE;
+        }
+        for (j = 0; j < SHA256_BLOCK; ++j) {
+            pad[j] = ((j < k->key_len) ? k->key[j] : 0) ^ 0x36;
+        }
+        memcpy(key_states[i].inner, sha256_iv, sizeof(sha256_iv));
+        sha256_compress(key_states[i].inner, pad);
+        for (j = 0; j < SHA256_BLOCK; ++j) {
+            pad[j] ^= 0x36 ^ 0x5C;
+        }
+        memcpy(key_states[i].outer, sha256_iv, sizeof(sha256_iv));
+        sha256_compress(key_states[i].outer, pad);
+    }
+    memset(pad, 0, sizeof(pad)); // Leave no key material on the stack
+
+    tx_key = find_key(ptp_opts.auth_tx_key_id);
+    if (tx_key < 0) {
+        xil_printf("PTPd: ERROR: Authentication key %d for sending is not in the key table\r\n",
+            ptp_opts.auth_tx_key_id);
+        return FALSE;
+    }
+    xil_printf("PTPd: Authentication: %d keys, sending with key %d, %d byte ICV\r\n",
+        ptp_opts.num_auth_keys, ptp_opts.auth_tx_key_id, ptp_opts.auth_keys[tx_key].icv_len);
+    return TRUE;
+}
+
+/**
+ * @brief Length of the AUTHENTICATION TLV auth_sign() appends.
+ * @return The TLV length, or 0 if messages are sent unsigned.
+ */
+int auth_tlv_len(void)
+{
+    if (!ptp_opts.auth || tx_key < 0) {
+        return 0;
+    }
+    return TLV_HEADER_LEN + AUTH_FIXED_LEN + ptp_opts.auth_keys[tx_key].icv_len;
+}
+
+/**
+ * @brief Append the AUTHENTICATION TLV to an outgoing message.
+ *
+ * The messageLength is updated to include the TLV. The buffer must have
+ * room for auth_tlv_len() more bytes.
+ *
+ * @param msg The message, from the PTP header.
+ * @param len Its length without the TLV.
+ * @return The new length.
+ */
+int auth_sign(uint8_t *msg, int len)
+{
+    const ptp_auth_key_t *k;
+    uint8_t mac[SHA256_DIGEST];
+    uint8_t *tlv = msg + len;
+    int total;
+
+    if (auth_tlv_len() == 0) {
+        return len;
+    }
+    k = &ptp_opts.auth_keys[tx_key];
+    total = len + auth_tlv_len();
+
+    msg[2] = (uint8_t)(total >> 8);
+    msg[3] = (uint8_t)total;
+    tlv[0] = (uint8_t)(TLV_AUTHENTICATION >> 8);
+    tlv[1] = (uint8_t)TLV_AUTHENTICATION;
+    tlv[2] = 0;
+    tlv[3] = (uint8_t)(AUTH_FIXED_LEN + k->icv_len);
+    tlv[4] = ptp_opts.auth_spp;
+    tlv[5] = 0; // secParamIndicator: immediate processing, no optional fields
+    tlv[6] = (uint8_t)(k->key_id >> 24);
+    tlv[7] = (uint8_t)(k->key_id >> 16);
+    tlv[8] = (uint8_t)(k->key_id >> 8);
+    tlv[9] = (uint8_t)k->key_id;
+
+    auth_hmac(&key_states[tx_key], msg, len + TLV_HEADER_LEN + AUTH_FIXED_LEN, mac);
+    memcpy(tlv + TLV_HEADER_LEN + AUTH_FIXED_LEN, mac, k->icv_len);
+    return total;
+}
+
+/**
+ * @brief Check the AUTHENTICATION TLV of a received message.
+ * @param msg The message, from the PTP header.
+ * @param len Length of the received data.
+ * @return TRUE if the message carries a valid ICV, FALSE to drop it.
+ */
+bool auth_verify(const uint8_t *msg, int len)
+{
+    const ptp_auth_key_t *k;
+    uint8_t mac[SHA256_DIGEST];
+    uint16_t tlv_type, tlv_len;
+    uint32_t key_id;
+    uint8_t diff = 0;
+    int offset = body_len[msg[0] & 0x0F];
+    int end = ((int)msg[2] << 8) | msg[3];
+    int i, key, icv;
+
+    if (end > len) {
+        end = len;
+    }
+
+    // The AUTHENTICATION TLV must be the last one (16.14.1)
+    while (offset != 0 && offset + TLV_HEADER_LEN <= end) {
+        tlv_type = ((uint16_t)msg[offset] << 8) | msg[offset + 1];
+        tlv_len = ((uint16_t)msg[offset + 2] << 8) | msg[offset + 3];
+        if (tlv_type == TLV_AUTHENTICATION && offset + TLV_HEADER_LEN + tlv_len == end) {
+            break;
+        }
+        offset += TLV_HEADER_LEN + tlv_len;
+    }
+    if (offset == 0 || offset + TLV_HEADER_LEN > end || tlv_len < AUTH_FIXED_LEN) {
+        missing++;
+        return FALSE;
+    }
+
+    key_id = ((uint32_t)msg[offset + 6] << 24) | ((uint32_t)msg[offset + 7] << 16) |
+             ((uint32_t)msg[offset + 8] << 8) | msg[offset + 9];
+    key = find_key(key_id);
+    icv = tlv_len - AUTH_FIXED_LEN;
+    if (key < 0 || msg[offset + 4] != ptp_opts.auth_spp || msg[offset + 5] != 0 ||
+        icv != ptp_opts.auth_keys[key].icv_len) {
+        unknown_key++;
+        return FALSE;
+    }
+    k = &ptp_opts.auth_keys[key];
+
+    auth_hmac(&key_states[key], msg, offset + TLV_HEADER_LEN + AUTH_FIXED_LEN, mac);
+    for (i = 0; i < k->icv_len; ++i) {
+        diff |= mac[i] ^ msg[offset + TLV_HEADER_LEN + AUTH_FIXED_LEN + i]; // Same time whatever the mismatch
+    }
+    if (diff != 0) {
+        bad_icv++;
+        return FALSE;
+    }
+    verified++;
+    return TRUE;
+}
+
+/**
+ * @brief Measure the cost of signing and verifying on this target.
+ *
+ * Run before enabling authentication at high message rates: every Sync,
+ * Follow_Up and Delay_Resp pays the verification cost on the slave, and a
+ * master pays the signing cost once per message and slave.
+ *
+ * @param iterations Messages signed and verified per message size.
+ */
+void auth_benchmark(uint32_t iterations)
+{
+    static const uint8_t sizes[] = { 44, 54, 64 }; // Sync, Delay_Resp, Announce
+    uint8_t msg[64 + TLV_HEADER_LEN + AUTH_FIXED_LEN + SHA256_DIGEST];
+    TimeInternal t0, t1, t2;
+    int64_t sign_ns, verify_ns;
+    uint32_t i, s, failed;
+
+    if (auth_tlv_len() == 0 || iterations == 0) {
+        xil_printf("PTPd: Authentication benchmark needs authentication enabled\r\n");
+        return;
+    }
+
+    for (s = 0; s < sizeof(sizes); ++s) {
+        memset(msg, 0, sizeof(msg));
+        msg[0] = (sizes[s] == 44) ? SYNC_MSG : (sizes[s] == 54) ? DELAY_RESP_MSG : ANNOUNCE_MSG;
+        sign_ns = verify_ns = 0;
+        failed = 0;
+
+        for (i = 0; i < iterations; ++i) {
+            getTime(&t0);
+            auth_sign(msg, sizes[s]);
+            getTime(&t1);
+            if (!auth_verify(msg, sizes[s] + auth_tlv_len())) {
+                failed++;
+            }
+            getTime(&t2);
+            sign_ns += (t1.seconds - t0.seconds) * 1000000000LL + (t1.nanoseconds - t0.nanoseconds);
+            verify_ns += (t2.seconds - t1.seconds) * 1000000000LL + (t2.nanoseconds - t1.nanoseconds);
+        }
+        xil_printf("PTPd: Authentication: %d byte message: sign %d ns, verify %d ns%s\r\n",
+            sizes[s], (int32_t)(sign_ns / iterations), (int32_t)(verify_ns / iterations),
+            failed ? " (VERIFY FAILED)" : "");
+    }
+    verified = 0;
+}
+
+/**
+ * @brief Print the verification counters.
+ */
+void auth_print_stats(void)
+{
+    xil_printf("PTPd: Authentication: %d verified, %d without TLV, %d unknown key, %d bad ICV\r\n",
+        verified, missing, unknown_key, bad_icv);
+}
@@ -0,0 +1,144 @@
+/**
+ * @file calib.c
+ * @brief Path asymmetry calibration against a reference PPS.
+ *
+ * A locked slave drives its measured offset to zero, so a constant error in
+ * the path (unequal fiber, SFP or switch delays in the two directions, or an
+ * uncorrected PHY latency) is invisible to the servo. It does show at the
+ * edge of a reference PPS from the grandmaster's time source: the local
+ * clock reads err nanoseconds past the second. Averaging err over a number
+ * of edges and moving it into the active path's delayAsymmetry removes it.
+ *
+ * The application timestamps the reference PPS with the local clock and
+ * passes the time to calib_pps_event(). The result is stored in ptp_opts so
+ * the next path_init() picks it up, and printed so it can be made permanent
+ * in the startup configuration.
+ */
+
+#include "../ptpd.h"
+#include <stdlib.h> // For abs()
+
+#define CALIB_LOCK_NS       1000   // Servo offset below which samples are taken
+#define CALIB_MAX_ERROR_NS  100000 // Larger PPS errors are treated as a wrong edge
+
+extern ptpd_opts ptp_opts;
+
+// --- Calibration State ---
+static bool calib_active;
+static uint8_t calib_path;       // Path whose asymmetry is calibrated
+static uint16_t calib_samples;   // Number of PPS edges to average
+static uint16_t calib_count;
+static int32_t calib_pps_delay;  // Reference PPS cable and input delay (ns)
+static int64_t calib_sum;
+static int32_t calib_min;
+static int32_t calib_max;
+
+// --- Helper Functions ---
+
+static void calib_reset(void)
+{
+    calib_count = 0;
+    calib_sum = 0;
+    calib_min = 0x7FFFFFFF;
+    calib_max = -0x7FFFFFFF;
+}
+
+/**
+ * @brief Apply the averaged error to the calibrated path.
+ */
+static void calib_finish(ptp_clock_t *clock)
+{
+    ptp_path_t *path = &clock->path[calib_path];
+    int32_t error = (int32_t)(calib_sum / calib_count);
+
+    // The servo settles where offset = delayAsymmetry - true asymmetry,
+    // and that is the error the PPS shows.
+    path->delay_asymmetry -= error;
+    ptp_opts.delay_asymmetry_ns[calib_path] = path->delay_asymmetry;
+    calib_active = FALSE;
+
+    xil_printf("PTPd: Calibration: path %d error %d ns (min %d, max %d, %d edges)\r\n",
+        calib_path, error, calib_min, calib_max, calib_count);
+    xil_printf("PTPd: Calibration: delay_asymmetry_ns[%d] = %d\r\n", calib_path, path->delay_asymmetry);
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Start measuring the active path's constant error against a PPS.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param num_samples Number of PPS edges to average.
+ * @param pps_delay_ns Delay of the reference PPS from its source to the
+ *        local timestamp (cable and input stage), subtracted from each edge.
+ */
+void calib_start(ptp_clock_t *clock, uint16_t num_samples, int32_t pps_delay_ns)
+{
+    calib_path = clock->active_path;
+    calib_samples = (num_samples > 0) ? num_samples : 1;
+    calib_pps_delay = pps_delay_ns;
+    calib_reset();
+    calib_active = TRUE;
+
+    xil_printf("PTPd: Calibration: path %d, %d PPS edges\r\n", calib_path, calib_samples);
+}
+
+/**
+ * @brief Feed one reference PPS edge into the calibration.
+ *
+ * Edges are only used while the port is SLAVE and the servo is locked. If
+ * the servo moves to another path the samples so far are discarded.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ * @param pps_time The local time of the PPS edge.
+ */
+void calib_pps_event(ptp_clock_t *clock, const TimeInternal *pps_time)
+{
+    int32_t error;
+
+    if (!calib_active) {
+        return;
+    }
+
+    if (clock->port_ds.port_state != PTP_SLAVE || clock->offset_from_master.seconds != 0 ||
+        abs(clock->offset_from_master.nanoseconds) > CALIB_LOCK_NS) {
+        return;
+    }
+
+    if (clock->active_path != calib_path) {
+        xil_printf("PTPd: Calibration: path changed, restarting on path %d\r\n", clock->active_path);
+        calib_path = clock->active_path;
+        calib_reset();
+    }
+
+    // Error from the nearest second boundary, positive when the local clock is ahead
+    error = pps_time->nanoseconds;
+    if (error >= 500000000) {
+        error -= 1000000000;
+    }
+    error -= calib_pps_delay;
+
+    if (abs(error) > CALIB_MAX_ERROR_NS) {
+        return;
+    }
+
+    calib_sum += error;
+    if (error < calib_min) {
+        calib_min = error;
+    }
+    if (error > calib_max) {
+        calib_max = error;
+    }
+
+    if (++calib_count >= calib_samples) {
+        calib_finish(clock);
+    }
+}
+
+/**
+ * @brief Check whether a calibration is in progress.
+ */
+bool calib_running(void)
+{
+    return calib_active;
+}
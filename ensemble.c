@@ -0,0 +1,442 @@
+/**
+ * @file ensemble.c
+ * @brief Multi-master ensemble offset estimation.
+ *
+ * In ensemble mode the slave measures its offset not only against the parent
+ * chosen by the BMC but also against the masters of additional PTP domains
+ * (ptpd_opts.ensemble_domains). Each master gets its own Sync/Delay_Req
+ * exchange, delay filter and noise estimate. When the parent's offset is
+ * updated, the offsets of all fresh masters are checked against their median
+ * to find a faulty master, and the remaining ones are combined with weights
+ * inversely proportional to their measured noise before being fed to the
+ * servo.
+ */
+
+#include "../ptpd.h"
+
+extern ptpd_opts ptp_opts;
+
+#define NOISE_SHIFT         3       // Noise variance smoothing: weight 1/8 per sample
+#define NOISE_VAR_MIN       100     // ns^2; keeps one quiet master from taking all weight
+#define WEIGHT_SCALE        (1LL << 30)
+#define MIN_QUALIFY_ANNOUNCES 2     // Announces needed before a master is measured
+#define ANNOUNCE_TIMEOUT    4       // Announce intervals before a master is dropped
+#define MIN_FAULT_VOTERS    3       // Masters needed to out-vote a faulty one
+
+// --- Ensemble Member Records ---
+typedef struct {
+    bool in_use;
+    bool faulty;
+    uint8_t domain;
+    int8_t log_announce_interval;
+    PortIdentity port_identity;
+    uint32_t announce_count;
+    TimeInternal last_announce;
+    ptp_path_t meas;                // Timestamps, delay and offset towards this master
+    int64_t noise_var;              // Smoothed squared change in offset (ns^2)
+    uint32_t fault_count;
+} ensemble_member_t;
+
+PTP_ARENA static ensemble_member_t members[PTP_MAX_ENSEMBLE];
+const uint32_t ensemble_arena_bytes = sizeof(members);
+
+// Noise and consensus state of the BMC-selected parent
+static int32_t parent_last_offset;
+static int64_t parent_noise_var;
+static bool parent_faulty;
+static uint32_t parent_fault_count;
+static int32_t last_estimate_ns;
+static uint8_t last_contributors;
+
+
+// --- Helper Functions ---
+
+static int64_t time_to_ns(const TimeInternal *t)
+{
+    return t->seconds * 1000000000LL + t->nanoseconds;
+}
+
+static int64_t log_interval_to_ns(int8_t log_interval)
+{
+    if (log_interval >= 0) {
+        return 1000000000LL << log_interval;
+    }
+    return 1000000000LL >> -log_interval;
+}
+
+/**
+ * @brief Check whether a domain is one of the configured ensemble domains.
+ */
+static bool is_ensemble_domain(uint8_t domain)
+{
+    uint8_t i;
+
+    for (i = 0; i < ptp_opts.ensemble_num_domains && i < PTP_MAX_ENSEMBLE; ++i) {
+        if (ptp_opts.ensemble_domains[i] == domain) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * @brief Find the record of a qualified master.
+ * @return The member, or NULL if the sender is unknown or not yet qualified.
+ */
+static ensemble_member_t *find_member(const PtpHeader *header)
+{
+    int i;
+
+    for (i = 0; i < PTP_MAX_ENSEMBLE; ++i) {
+        ensemble_member_t *m = &members[i];
+        if (m->in_use && m->domain == header->domainNumber &&
+            m->announce_count >= MIN_QUALIFY_ANNOUNCES &&
+            memcmp(m->port_identity.clockIdentity, header->sourcePortIdentity.clockIdentity, 8) == 0 &&
+            m->port_identity.portNumber == header->sourcePortIdentity.portNumber) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Update a noise estimate with the change between two offsets.
+ */
+static void update_noise(int64_t *noise_var, int32_t previous, int32_t current)
+{
+    int64_t change = (int64_t)current - previous;
+    *noise_var += (change * change - *noise_var) >> NOISE_SHIFT;
+}
+
+/**
+ * @brief Complete an offset measurement towards an ensemble member.
+ */
+static void member_offset_ready(ensemble_member_t *m, const TimeInternal *precise_origin_timestamp)
+{
+    int32_t previous = m->meas.offset_from_master.nanoseconds;
+
+    servo_update_path_offset(&m->meas, precise_origin_timestamp);
+    m->meas.sync_count++;
+
+    if (m->meas.delay_valid && m->meas.sync_count > 1 && m->meas.offset_from_master.seconds == 0) {
+        update_noise(&m->noise_var, previous, m->meas.offset_from_master.nanoseconds);
+    }
+}
+
+/**
+ * @brief Sort a small array of offsets (insertion sort).
+ */
+static void sort_offsets(int32_t *v, int n)
+{
+    int i, j;
+
+    for (i = 1; i < n; ++i) {
+        int32_t x = v[i];
+        for (j = i - 1; j >= 0 && v[j] > x; --j) {
+            v[j + 1] = v[j];
+        }
+        v[j + 1] = x;
+    }
+}
+
+/**
+ * @brief Flag or clear a master as faulty after a consensus vote.
+ */
+static void vote(bool *faulty, uint32_t *fault_count, int32_t offset, int32_t median, const char *who)
+{
+    int32_t deviation = offset - median;
+
+    if (deviation < 0) {
+        deviation = -deviation;
+    }
+
+    if (!*faulty && deviation > ptp_opts.ensemble_fault_ns) {
+        *faulty = TRUE;
+        (*fault_count)++;
+        xil_printf("PTPd: Ensemble: %s disagrees with consensus by %d ns, excluded\r\n", who, deviation);
+    } else if (*faulty && deviation < ptp_opts.ensemble_fault_ns / 2) {
+        *faulty = FALSE;
+        xil_printf("PTPd: Ensemble: %s agrees with consensus again\r\n", who);
+    }
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Clear all ensemble state.
+ */
+void ensemble_init(void)
+{
+    memset(members, 0, sizeof(members));
+    parent_last_offset = 0;
+    parent_noise_var = 0;
+    parent_faulty = FALSE;
+    last_estimate_ns = 0;
+    last_contributors = 0;
+}
+
+/**
+ * @brief Qualify a master announcing on one of the ensemble domains.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param header The header of the Announce message.
+ * @param announce The body of the Announce message.
+ */
+void ensemble_announce(ptp_clock_t *clock, const PtpHeader *header, const AnnounceMessage *announce)
+{
+    ensemble_member_t *m = NULL;
+    ensemble_member_t *free_slot = NULL;
+    int i;
+
+    if (!ptp_opts.ensemble || !is_ensemble_domain(header->domainNumber)) {
+        return;
+    }
+
+    for (i = 0; i < PTP_MAX_ENSEMBLE; ++i) {
+        if (!members[i].in_use) {
+            if (free_slot == NULL) {
+                free_slot = &members[i];
+            }
+        } else if (members[i].domain == header->domainNumber &&
+                   memcmp(members[i].port_identity.clockIdentity, header->sourcePortIdentity.clockIdentity, 8) == 0 &&
+                   members[i].port_identity.portNumber == header->sourcePortIdentity.portNumber) {
+            m = &members[i];
+            break;
+        }
+    }
+
+    if (m == NULL) {
+        if (free_slot == NULL) {
+            return; // Table full
+        }
+        m = free_slot;
+        memset(m, 0, sizeof(*m));
+        m->in_use = TRUE;
+        m->domain = header->domainNumber;
+        m->port_identity = header->sourcePortIdentity;
+        m->meas.owd_filt.s = 4;
+        m->meas.link_up = TRUE;
+        // Same port as the parent, so the same latency and asymmetry corrections
+        m->meas.delay_asymmetry = clock->path[clock->active_path].delay_asymmetry;
+        m->meas.ingress_latency = clock->path[clock->active_path].ingress_latency;
+        m->meas.egress_latency = clock->path[clock->active_path].egress_latency;
+        xil_printf("PTPd: Ensemble: new master on domain %d\r\n", m->domain);
+    }
+
+    m->log_announce_interval = header->logMessageInterval;
+    m->announce_count++;
+    getTime(&m->last_announce);
+}
+
+/**
+ * @brief Handle a Sync from a master other than the parent.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param header The header of the Sync message.
+ * @param sync_receive_time T2, captured on arrival.
+ * @param origin_timestamp T1 for one-step masters.
+ */
+void ensemble_sync(ptp_clock_t *clock, const PtpHeader *header, const TimeInternal *sync_receive_time, const TimeInternal *origin_timestamp)
+{
+    ensemble_member_t *m;
+
+    if (!ptp_opts.ensemble || (m = find_member(header)) == NULL) {
+        return;
+    }
+
+    m->meas.sync_receive_time = *sync_receive_time;
+    m->meas.sync_sequence_id = header->sequenceId;
+    m->meas.log_sync_interval = header->logMessageInterval;
+    m->meas.sync_seen = TRUE;
+
+    if (!(header->flags & 0x0200)) { // 1-step clock
+        member_offset_ready(m, origin_timestamp);
+    } else {
+        m->meas.waiting_for_followup = TRUE;
+    }
+}
+
+/**
+ * @brief Handle a Follow_Up from a master other than the parent.
+ */
+void ensemble_follow_up(ptp_clock_t *clock, const PtpHeader *header, const TimeInternal *precise_origin_timestamp)
+{
+    ensemble_member_t *m;
+
+    if (!ptp_opts.ensemble || (m = find_member(header)) == NULL) {
+        return;
+    }
+
+    if (m->meas.waiting_for_followup && header->sequenceId == m->meas.sync_sequence_id) {
+        m->meas.waiting_for_followup = FALSE;
+        member_offset_ready(m, precise_origin_timestamp);
+    }
+}
+
+/**
+ * @brief Handle a Delay_Resp that may answer an ensemble Delay_Req.
+ * @return TRUE if the message belonged to the ensemble, FALSE otherwise.
+ */
+bool ensemble_delay_resp(ptp_clock_t *clock, const PtpHeader *header, const TimeInternal *recv_timestamp, const PortIdentity *requesting_port_identity)
+{
+    ensemble_member_t *m;
+
+    if (!ptp_opts.ensemble || header->domainNumber == clock->default_ds.domain_number) {
+        return FALSE;
+    }
+
+    m = find_member(header);
+    if (m != NULL && header->sequenceId == m->meas.delay_req_sequence_id &&
+        memcmp(requesting_port_identity->clockIdentity, clock->port_ds.port_identity.clockIdentity, 8) == 0) {
+        servo_update_path_delay(&m->meas, recv_timestamp);
+    }
+    return TRUE;
+}
+
+/**
+ * @brief Send a Delay_Req to every qualified ensemble master.
+ *
+ * Called together with the parent's Delay_Req. Masters whose Announces have
+ * stopped are dropped here.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void ensemble_issue_delay_reqs(ptp_clock_t *clock)
+{
+    uint8_t buf[44];
+    TimeInternal now;
+    int i;
+
+    if (!ptp_opts.ensemble) {
+        return;
+    }
+
+    getTime(&now);
+    for (i = 0; i < PTP_MAX_ENSEMBLE; ++i) {
+        ensemble_member_t *m = &members[i];
+
+        if (!m->in_use) {
+            continue;
+        }
+        if (time_to_ns(&now) - time_to_ns(&m->last_announce) > ANNOUNCE_TIMEOUT * log_interval_to_ns(m->log_announce_interval)) {
+            xil_printf("PTPd: Ensemble: master on domain %d timed out\r\n", m->domain);
+            m->in_use = FALSE;
+            continue;
+        }
+        if (m->announce_count < MIN_QUALIFY_ANNOUNCES) {
+            continue;
+        }
+
+        m->meas.delay_req_sequence_id = clock->sent_delay_req_sequence_id;
+        getTime(&m->meas.delay_req_send_time);
+        msg_pack_delay_req(buf, clock, &m->meas.delay_req_send_time);
+        buf[4] = m->domain; // domainNumber: ask this domain's master
+        net_send_event(buf, 44);
+        net_get_tx_timestamp(&m->meas.delay_req_send_time);
+        clock->sent_delay_req_sequence_id++;
+    }
+}
+
+/**
+ * @brief Combine the parent's offset with the other masters' offsets.
+ *
+ * Called each time the parent's offset is updated. Masters whose last Sync
+ * is older than two Sync intervals, or whose path delay is not yet known,
+ * are left out. With at least MIN_FAULT_VOTERS masters, any master (the
+ * parent included) further than ensemble_fault_ns from the median is
+ * excluded. The rest are averaged with weights of 1 / noise variance.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ * @param parent_offset The parent's unfiltered offset from master.
+ * @param estimate Receives the combined offset.
+ * @return TRUE if an ensemble estimate was produced, FALSE to use the parent alone.
+ */
+bool ensemble_estimate(ptp_clock_t *clock, const TimeInternal *parent_offset, TimeInternal *estimate)
+{
+    ensemble_member_t *fresh[PTP_MAX_ENSEMBLE];
+    int32_t sorted[PTP_MAX_ENSEMBLE + 1];
+    int64_t weighted_sum = 0;
+    int64_t weight_total = 0;
+    int64_t now_ns;
+    int32_t median;
+    int n = 0;
+    int i;
+
+    if (!ptp_opts.ensemble || parent_offset->seconds != 0) {
+        return FALSE;
+    }
+
+    update_noise(&parent_noise_var, parent_last_offset, parent_offset->nanoseconds);
+    parent_last_offset = parent_offset->nanoseconds;
+
+    now_ns = time_to_ns(&clock->path[clock->active_path].sync_receive_time);
+    for (i = 0; i < PTP_MAX_ENSEMBLE; ++i) {
+        ensemble_member_t *m = &members[i];
+        if (m->in_use && m->meas.delay_valid && m->meas.offset_from_master.seconds == 0 &&
+            now_ns - time_to_ns(&m->meas.sync_receive_time) < 2 * log_interval_to_ns(m->meas.log_sync_interval)) {
+            fresh[n++] = m;
+        }
+    }
+    if (n == 0) {
+        return FALSE;
+    }
+
+    // Consensus: compare everyone against the median
+    if (n + 1 >= MIN_FAULT_VOTERS) {
+        sorted[0] = parent_offset->nanoseconds;
+        for (i = 0; i < n; ++i) {
+            sorted[i + 1] = fresh[i]->meas.offset_from_master.nanoseconds;
+        }
+        sort_offsets(sorted, n + 1);
+        median = ((n + 1) & 1) ? sorted[(n + 1) / 2] : (sorted[n / 2] + sorted[n / 2 + 1]) / 2;
+
+        vote(&parent_faulty, &parent_fault_count, parent_offset->nanoseconds, median, "parent");
+        for (i = 0; i < n; ++i) {
+            vote(&fresh[i]->faulty, &fresh[i]->fault_count, fresh[i]->meas.offset_from_master.nanoseconds, median, "domain master");
+        }
+    }
+
+    // Inverse-noise weighted mean of the trusted masters
+    last_contributors = 0;
+    if (!parent_faulty) {
+        int64_t w = WEIGHT_SCALE / (parent_noise_var > NOISE_VAR_MIN ? parent_noise_var : NOISE_VAR_MIN);
+        weighted_sum += w * parent_offset->nanoseconds;
+        weight_total += w;
+        last_contributors++;
+    }
+    for (i = 0; i < n; ++i) {
+        if (!fresh[i]->faulty) {
+            int64_t w = WEIGHT_SCALE / (fresh[i]->noise_var > NOISE_VAR_MIN ? fresh[i]->noise_var : NOISE_VAR_MIN);
+            weighted_sum += w * fresh[i]->meas.offset_from_master.nanoseconds;
+            weight_total += w;
+            last_contributors++;
+        }
+    }
+    if (weight_total == 0) {
+        return FALSE;
+    }
+
+    last_estimate_ns = (int32_t)(weighted_sum / weight_total);
+    estimate->seconds = 0;
+    estimate->nanoseconds = last_estimate_ns;
+    return TRUE;
+}
+
+/**
+ * @brief Print the ensemble members and the last combined estimate.
+ */
+void ensemble_print_stats(void)
+{
+    int i;
+
+    xil_printf("PTPd: Ensemble estimate %d ns from %d masters; parent %s, noise %d ns^2, faults %d\r\n",
+        last_estimate_ns, last_contributors, parent_faulty ? "EXCLUDED" : "ok",
+        (int32_t)parent_noise_var, parent_fault_count);
+    for (i = 0; i < PTP_MAX_ENSEMBLE; ++i) {
+        ensemble_member_t *m = &members[i];
+        if (m->in_use) {
+            xil_printf("PTPd:   domain %d: offset %d ns, delay %d ns, noise %d ns^2, %s, faults %d\r\n",
+                m->domain, m->meas.offset_from_master.nanoseconds, m->meas.mean_path_delay.nanoseconds,
+                (int32_t)m->noise_var, m->faulty ? "EXCLUDED" : "ok", m->fault_count);
+        }
+    }
+}
@@ -0,0 +1,197 @@
+/**
+ * @file event.c
+ * @brief External event timestamping through AXI timer capture.
+ *
+ * A second AXI Timer runs both of its counters in capture mode, one per
+ * capture input (capturetrig0/1 in the block design: a trigger, the PPS of
+ * other equipment). The counter value is latched by the hardware on the
+ * edge, so interrupt latency does not enter the timestamp. The ISR only
+ * measures how long ago the edge was on the capture counter, takes that
+ * from a sample of the PTP clock's own tick count, and queues the result
+ * with the servo offset valid at that moment. Conversion to PTP time is
+ * left to the main loop.
+ *
+ * Both timers must be clocked from the same source. Define
+ * PTP_EVENT_TMRCTR_DEVICE_ID (see ptpd_config.h) to build the module. The
+ * application connects event_isr() to the capture timer's interrupt and
+ * reads events with event_poll(), or registers a callback run from the
+ * protocol tick.
+ * Edges of ptpd_opts.pps_event_channel feed a running path asymmetry
+ * calibration.
+ */
+
+#include "../ptpd.h"
+#include "xtmrctr.h"
+
+#ifdef PTP_EVENT_TMRCTR_DEVICE_ID
+
+extern ptpd_opts ptp_opts;
+
+#define EVENT_CHANNELS      2 // One capture input per counter
+
+// A captured edge, as queued by the ISR
+typedef struct {
+    u64_t ticks;            // PTP clock tick count at the edge
+    int64_t offset_ns;      // Servo offset at the edge
+    uint32_t sequence;
+    uint8_t channel;
+} event_capture_t;
+
+PTP_LMB_DATA static XTmrCtr EventTimer;
+PTP_ARENA static event_capture_t ring[PTP_EVENT_QUEUE_LEN];
+const uint32_t event_arena_bytes = sizeof(ring);
+
+// Written by the ISR only (head) or by the main loop only (tail)
+static volatile uint32_t ring_head;
+static volatile uint32_t ring_tail;
+static volatile uint32_t captures; // Edges seen, queued or not
+static volatile uint32_t overruns;
+static event_callback_t event_callback;
+
+_Static_assert((PTP_EVENT_QUEUE_LEN & (PTP_EVENT_QUEUE_LEN - 1)) == 0, "PTP_EVENT_QUEUE_LEN must be a power of two");
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Put both counters of the capture timer into capture mode.
+ * @return TRUE on success, FALSE otherwise.
+ */
+bool event_init(void)
+{
+    uint8_t ch;
+
+    if (XTmrCtr_Initialize(&EventTimer, PTP_EVENT_TMRCTR_DEVICE_ID) != XST_SUCCESS) {
+        xil_printf("PTPd: ERROR: Failed to initialize event capture timer!\r\n");
+        return FALSE;
+    }
+
+    for (ch = 0; ch < EVENT_CHANNELS; ++ch) {
+        XTmrCtr_Stop(&EventTimer, ch);
+        // Free running, capture mode (latches the count on the capturetrig
+        // edge), overwrite the capture register on every edge, interrupt on
+        // every edge
+        XTmrCtr_SetOptions(&EventTimer, ch, XTC_CAPTURE_MODE_OPTION | XTC_AUTO_RELOAD_OPTION |
+                                            XTC_INT_MODE_OPTION);
+        XTmrCtr_SetResetValue(&EventTimer, ch, 0);
+        XTmrCtr_Reset(&EventTimer, ch);
+        XTmrCtr_Start(&EventTimer, ch);
+    }
+
+    ring_head = 0;
+    ring_tail = 0;
+    captures = 0;
+    overruns = 0;
+    xil_printf("PTPd: Event capture started on %d inputs\r\n", EVENT_CHANNELS);
+    return TRUE;
+}
+
+/**
+ * @brief Capture timer interrupt handler.
+ *
+ * Connect to the interrupt controller in place of XTmrCtr_InterruptHandler.
+ *
+ * @param ref Unused.
+ */
+PTP_LMB_TEXT void event_isr(void *ref)
+{
+    uint32_t csr, captured, before, after;
+    int64_t offset_ns;
+    event_capture_t *c;
+    u64_t now;
+    uint8_t ch;
+
+    for (ch = 0; ch < EVENT_CHANNELS; ++ch) {
+        csr = XTmrCtr_ReadReg(EventTimer.BaseAddress, ch, XTC_TCSR_OFFSET);
+        if (!(csr & XTC_CSR_INT_OCCURED_MASK)) {
+            continue;
+        }
+
+        // The edge was (counter - latched value) ticks ago, modulo 2^32.
+        // The capture counter is read on both sides of the PTP clock
+        // sample, and the midpoint taken, so the register reads add no bias.
+        captured = XTmrCtr_ReadReg(EventTimer.BaseAddress, ch, XTC_TLR_OFFSET);
+        before = XTmrCtr_ReadReg(EventTimer.BaseAddress, ch, XTC_TCR_OFFSET);
+        now = ptpd_hw_read_ticks(&offset_ns);
+        after = XTmrCtr_ReadReg(EventTimer.BaseAddress, ch, XTC_TCR_OFFSET);
+        XTmrCtr_WriteReg(EventTimer.BaseAddress, ch, XTC_TCSR_OFFSET, csr | XTC_CSR_INT_OCCURED_MASK);
+
+        if (ring_head - ring_tail >= PTP_EVENT_QUEUE_LEN) {
+            overruns++;
+            captures++;
+            continue;
+        }
+        c = &ring[ring_head & (PTP_EVENT_QUEUE_LEN - 1)];
+        c->ticks = now - (before + (after - before) / 2 - captured);
+        c->offset_ns = offset_ns;
+        c->sequence = captures++;
+        c->channel = ch;
+        ring_head++;
+    }
+}
+
+/**
+ * @brief Take the oldest captured event from the queue.
+ * @param event Receives the event, in PTP time.
+ * @return TRUE if an event was waiting, FALSE otherwise.
+ */
+bool event_poll(ptp_event_t *event)
+{
+    const event_capture_t *c;
+
+    if (ring_tail == ring_head) {
+        return FALSE;
+    }
+    c = &ring[ring_tail & (PTP_EVENT_QUEUE_LEN - 1)];
+    ptpd_hw_ticks_to_time(c->ticks, c->offset_ns, &event->time);
+    event->channel = c->channel;
+    event->sequence = c->sequence;
+    ring_tail++;
+    return TRUE;
+}
+
+/**
+ * @brief Have events delivered from the protocol tick instead of polled.
+ * @param callback Called once per event, or NULL to go back to polling.
+ */
+void event_set_callback(event_callback_t callback)
+{
+    event_callback = callback;
+}
+
+/**
+ * @brief Deliver queued events, called every protocol tick.
+ *
+ * Without a callback or a calibration to feed, events stay queued for
+ * event_poll().
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void event_tick(ptp_clock_t *clock)
+{
+    ptp_event_t event;
+    bool calib = calib_running() && ptp_opts.pps_event_channel >= 0;
+
+    if (event_callback == NULL && !calib) {
+        return;
+    }
+    while (event_poll(&event)) {
+        if (calib && event.channel == ptp_opts.pps_event_channel) {
+            calib_pps_event(clock, &event.time);
+        }
+        if (event_callback != NULL) {
+            event_callback(&event);
+        }
+    }
+}
+
+/**
+ * @brief Print the event capture counters.
+ */
+void event_print_stats(void)
+{
+    xil_printf("PTPd: Events: %d captured, %d queued, %d lost to a full queue\r\n",
+        captures, ring_head - ring_tail, overruns);
+}
+
+#endif /* PTP_EVENT_TMRCTR_DEVICE_ID */
@@ -28,13 +28,30 @@
 #define DEFAULT_IP_MASK     "255.255.255.0"
 #define DEFAULT_GW_ADDRESS  "192.168.1.1"
 
+// Optional second AXI Ethernet (second SFP cage) used as a redundant PTP path
+#ifdef XPAR_AXIETHERNET_1_BASEADDR
+#define REDUNDANT_EMAC_BASEADDR     XPAR_AXIETHERNET_1_BASEADDR
+#define REDUNDANT_IP_ADDRESS        "192.168.2.10"
+#define REDUNDANT_IP_MASK           "255.255.255.0"
+#define REDUNDANT_GW_ADDRESS        "192.168.2.1"
+#endif
+
+// PTP profile: PTP_PROFILE_DEFAULT_E2E (UDP/IPv4), PTP_PROFILE_GPTP (IEEE 802.1AS),
+// PTP_PROFILE_G8275_1 (telecom, Ethernet) or PTP_PROFILE_G8275_2 (telecom, unicast UDP)
+#define PTP_PROFILE         PTP_PROFILE_DEFAULT_E2E
+
+// G.8275.2 unicast master table: the PTP master(s) this board asks for service
+#define UNICAST_MASTER_IP   "192.168.1.100"
+
 // ** IMPORTANT: Update these IDs to match your Vivado Block Design **
 #define INTC_DEVICE_ID      XPAR_INTC_0_DEVICE_ID
 #define TMRCTR_DEVICE_ID    XPAR_TMRCTR_0_DEVICE_ID
 #define TIMER_IRPT_INTR     XPAR_INTC_0_TMRCTR_0_VEC_ID
+#ifdef PTP_EVENT_TMRCTR_DEVICE_ID
+#define EVENT_IRPT_INTR     XPAR_INTC_0_TMRCTR_1_VEC_ID // Capture timer of event.c
+#endif
 
-// PTP periodic tick rate (10 Hz = 100ms)
-#define PTP_TICK_RATE_HZ    10
+// PTP periodic tick rate: PTP_TICK_RATE_HZ in ptpd.h
 #define TIMER_RESET_VALUE   (XPAR_AXI_TIMER_0_CLOCK_FREQ_HZ / PTP_TICK_RATE_HZ)
 
 // --- Global Variables ---
@@ -42,6 +59,9 @@ extern volatile int TcpFastTmrFlag;
 extern volatile int TcpSlowTmrFlag;
 
 struct netif server_netif;
+#ifdef REDUNDANT_EMAC_BASEADDR
+struct netif redundant_netif;
+#endif
 static XIntc interrupt_controller;
 static XTmrCtr timer_controller;
 
@@ -49,9 +69,9 @@ static XTmrCtr timer_controller;
 volatile int ptp_timer_flag = 0;
 
 // PTP Globals
-ptp_clock_t ptp_clock;
-ptpd_opts ptp_opts;
-foreign_master_record_t foreign_records[PTPD_DEFAULT_MAX_FOREIGN_RECORDS];
+// The data sets are read on every timestamped message, keep them in the LMB
+PTP_LMB_DATA ptp_clock_t ptp_clock;
+PTP_LMB_DATA ptpd_opts ptp_opts;
 sys_mbox_t ptp_alert_queue;
 
 // --- Function Prototypes ---
@@ -85,16 +105,95 @@ void ptpd_opts_init()
     xil_printf("Initializing ptpd options...\r\n");
 
     memset(&ptp_opts, 0, sizeof(ptpd_opts));
+    ptp_opts.profile = PTP_PROFILE;
+    ptp_opts.transport = PTP_TRANSPORT_UDP;
     ptp_opts.slave_only = 0;
-    ptp_opts.sync_interval = 1;
-    ptp_opts.announce_interval = 1;
+    ptp_opts.domain_number = 0;
+    ptp_opts.sync_interval = 0;       // 1 s
+    ptp_opts.announce_interval = 1;   // 2 s
+    ptp_opts.delay_req_interval = 0;  // 1 s
+    ptp_opts.announce_receipt_timeout = 3;
     ptp_opts.clock_quality.clock_class = 248;
     ptp_opts.clock_quality.clock_accuracy = 0xFE;
     ptp_opts.clock_quality.offset_scaled_log_variance = 0xFFFF;
     ptp_opts.priority1 = 128;
     ptp_opts.priority2 = 128;
+    ptp_opts.mcast_groups = PTP_MCAST_GROUPS_IPV4;
+    ptp_opts.dscp_event = PTP_DSCP_EF;
+    ptp_opts.dscp_general = PTP_DSCP_AF41;
+    ptp_opts.vlan_id = PTP_VLAN_NONE;
+    ptp_opts.vlan_pcp_event = 7;
+    ptp_opts.vlan_pcp_general = 5;
+    ptp_opts.udp_checksum = PTP_UDP_CSUM_SOFTWARE;
+    ptp_opts.ensemble = FALSE;
+    ptp_opts.ensemble_fault_ns = 1000;
+    ptp_opts.monitor = FALSE;
+    ptp_opts.monitor_alarm_ns = 1000;
+    ptp_opts.ntp_server = FALSE;
+    ptp_opts.sync_rate_adaptive = FALSE;
+    ptp_opts.sync_interval_min = -4; // 16/s
+    ptp_opts.sync_interval_max = 0;  // 1/s
+    ptp_opts.sync_rate_jitter_high_ns = 500;
+    ptp_opts.sync_rate_jitter_low_ns = 100;
+    ptp_opts.delay_req_adaptive = FALSE;
+    ptp_opts.delay_req_interval_max = 3; // 8 s
+    ptp_opts.delay_req_stable_ns = 200;
+    ptp_opts.delay_req_change_ns = 1000;
+    ptp_opts.delay_req_limit = TRUE;
+    ptp_opts.delay_req_max_rate = 256;
+    ptp_opts.syntonize_only = FALSE;
+    ptp_opts.syntonize_lock_ppb = 100;
+    ptp_opts.pps_event_channel = -1;
+    ptp_opts.acceptable_master_only = FALSE;
+    ptp_opts.num_acceptable_masters = 0;
+    ptp_opts.auth = FALSE;
+    ptp_opts.auth_spp = 0;
+    ptp_opts.auth_tx_key_id = 1;
+    ptp_opts.num_auth_keys = 0;
+    ptp_opts.neighbor_prop_delay_thresh_ns = GPTP_NEIGHBOR_PROP_DELAY_THRESH;
+    ptp_opts.local_priority = G8275_LOCAL_PRIORITY_DEFAULT;
+    ptp_opts.port_local_priority[0] = G8275_LOCAL_PRIORITY_DEFAULT;
+    ptp_opts.port_local_priority[1] = G8275_LOCAL_PRIORITY_DEFAULT;
+    ptp_opts.gm_step_policy = PTP_GM_STEP_FOLLOW;
+    ptp_opts.gm_step_confirmations = 4;
+    ptp_opts.gm_step_threshold_ns = 1000000; // 1 ms
+    // delay_asymmetry_ns/ingress_latency_ns/egress_latency_ns stay 0 until
+    // measured for the board and link, e.g. with calib_start()
+
+    switch (ptp_opts.profile) {
+    case PTP_PROFILE_GPTP:
+        // 802.1AS: Ethernet transport to the peer group address, 1 s Announce
+        ptp_opts.transport = PTP_TRANSPORT_L2;
+        ptp_opts.mcast_groups = PTP_MCAST_GROUPS_L2;
+        ptp_opts.announce_interval = 0;
+        break;
+    case PTP_PROFILE_G8275_1:
+        // G.8275.1 Table A.2/A.3: Ethernet multicast, 16 Sync/s, 16 Delay_Req/s, 8 Announce/s
+        ptp_opts.transport = PTP_TRANSPORT_L2;
+        ptp_opts.mcast_groups = PTP_MCAST_GROUPS_L2;
+        ptp_opts.domain_number = G8275_1_DOMAIN;
+        ptp_opts.sync_interval = -4;
+        ptp_opts.delay_req_interval = -4;
+        ptp_opts.announce_interval = -3;
+        ptp_opts.priority1 = 128; // Static in the telecom profiles
+        break;
+    case PTP_PROFILE_G8275_2:
+        // G.8275.2 Table A.2/A.3: negotiated unicast, 16 Sync/s, 16 Delay_Req/s, 1 Announce/s
+        ptp_opts.unicast = TRUE;
+        ptp_opts.domain_number = G8275_2_DOMAIN;
+        ptp_opts.sync_interval = -4;
+        ptp_opts.delay_req_interval = -4;
+        ptp_opts.announce_interval = 0;
+        ptp_opts.priority1 = 128;
+        ptp_opts.num_unicast_masters = 1;
+        inet_aton(UNICAST_MASTER_IP, &ptp_opts.unicast_masters[0].address);
+        ptp_opts.unicast_masters[0].local_priority = G8275_LOCAL_PRIORITY_DEFAULT;
+        break;
+    default:
+        break;
+    }
 
-    if (ptp_startup(&ptp_clock, &ptp_opts, foreign_records) != 0) {
+    if (ptp_startup(&ptp_clock, &ptp_opts) != 0) {
         xil_printf("PTP startup failed!\r\n");
     }
 }
@@ -133,10 +232,42 @@ int main()
     // Create ptp_alert_queue
     ptp_alert_queue = sys_mbox_new();
 
+#ifdef REDUNDANT_EMAC_BASEADDR
+    // Bring up the second interface; PTP listens on both and fails over
+    unsigned char redundant_mac_address[] = {
+        0x00, 0x0a, 0x35, 0x00, 0x01, 0x03 };
+
+    if (xemac_add(&redundant_netif, NULL, NULL, NULL, redundant_mac_address,
+                  REDUNDANT_EMAC_BASEADDR)) {
+        inet_aton(REDUNDANT_IP_ADDRESS, &(redundant_netif.ip_addr));
+        inet_aton(REDUNDANT_IP_MASK, &(redundant_netif.netmask));
+        inet_aton(REDUNDANT_GW_ADDRESS, &(redundant_netif.gw));
+        netif_set_up(&redundant_netif);
+        print_ip("Redundant IP", &(redundant_netif.ip_addr));
+
+        ptpd_net_add_interface(netif);
+        ptpd_net_add_interface(&redundant_netif);
+    } else {
+        xil_printf("Error adding redundant network interface\r\n");
+    }
+#endif
+
     // Setup ptpd and register UDP handlers
     ptpd_opts_init();
     ptpd_net_init(&ptp_clock.net_path);
 
+#ifdef PTP_LMB_BENCHMARK
+    // Memory placement report; the jitter figure is to be compared between
+    // builds with and without PTP_USE_LMB
+    ptpd_hw_print_lmb_usage();
+    ptpd_hw_measure_jitter(1000);
+#endif
+#ifdef PTP_AUTH_BENCHMARK
+    if (ptp_opts.auth) {
+        auth_benchmark(1000); // Per-message cost of the ICV at this clock rate
+    }
+#endif
+
     xil_printf("PTP initialized. Starting main loop...\r\n");
 
     while (1) {
@@ -152,6 +283,9 @@ int main()
 
         // Poll for incoming network packets
         xemacif_input(netif);
+#ifdef REDUNDANT_EMAC_BASEADDR
+        xemacif_input(&redundant_netif);
+#endif
 
         // Check if the periodic timer has fired
         if (ptp_timer_flag) {
@@ -196,6 +330,16 @@ static int setup_interrupt_system()
         return XST_FAILURE;
     }
 
+#ifdef PTP_EVENT_TMRCTR_DEVICE_ID
+    // Timestamp external events on the capture timer's inputs
+    if (event_init()) {
+        status = XIntc_Connect(&interrupt_controller, EVENT_IRPT_INTR, (XInterruptHandler)event_isr, NULL);
+        if (status != XST_SUCCESS) {
+            return XST_FAILURE;
+        }
+    }
+#endif
+
     // Start the interrupt controller
     status = XIntc_Start(&interrupt_controller, XIN_REAL_MODE);
     if (status != XST_SUCCESS) {
@@ -204,6 +348,9 @@ static int setup_interrupt_system()
 
     // Enable the timer interrupt in the interrupt controller
     XIntc_Enable(&interrupt_controller, TIMER_IRPT_INTR);
+#ifdef PTP_EVENT_TMRCTR_DEVICE_ID
+    XIntc_Enable(&interrupt_controller, EVENT_IRPT_INTR);
+#endif
 
     // Set the timer handler that will be called from the driver's ISR
     XTmrCtr_SetHandler(&timer_controller, Timer_ISR_Handler, NULL);
@@ -211,7 +358,7 @@ static int setup_interrupt_system()
     // Configure the timer for auto-reload (periodic) mode
     XTmrCtr_SetOptions(&timer_controller, 0, XTC_INT_MODE_OPTION | XTC_AUTO_RELOAD_OPTION);
 
-    // Set the timer reset value for a 10 Hz tick rate
+    // Set the timer reset value for the PTP_TICK_RATE_HZ tick rate
     XTmrCtr_SetResetValue(&timer_controller, 0, TIMER_RESET_VALUE);
 
     // Start the timer
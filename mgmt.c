@@ -0,0 +1,426 @@
+/**
+ * @file mgmt.c
+ * @brief Management messages: remote GET/SET of the PTP data sets.
+ *
+ * Answers the IEEE 1588-2008 clause 15 requests sent by management tools
+ * such as linuxptp's pmc. Every supported response is kept fully packed
+ * in a cache that is refreshed, one entry at a time, from the protocol
+ * tick. A GET therefore costs one copy and a few patched bytes on the
+ * receive path, however often a monitoring system polls.
+ */
+
+#include "../ptpd.h"
+
+#ifndef PTP_SLAVE_ONLY
+
+extern ptpd_opts ptp_opts;
+
+// --- managementId values (IEEE 1588-2008 Table 40) ---
+#define MGMT_NULL_MANAGEMENT                0x0000
+#define MGMT_DEFAULT_DATA_SET               0x2000
+#define MGMT_CURRENT_DATA_SET               0x2001
+#define MGMT_PARENT_DATA_SET                0x2002
+#define MGMT_TIME_PROPERTIES_DATA_SET       0x2003
+#define MGMT_PORT_DATA_SET                  0x2004
+#define MGMT_PRIORITY1                      0x2005
+#define MGMT_PRIORITY2                      0x2006
+#define MGMT_DOMAIN                         0x2007
+#define MGMT_SLAVE_ONLY                     0x2008
+#define MGMT_LOG_ANNOUNCE_INTERVAL          0x2009
+#define MGMT_ANNOUNCE_RECEIPT_TIMEOUT       0x200A
+#define MGMT_LOG_SYNC_INTERVAL              0x200B
+#define MGMT_VERSION_NUMBER                 0x200C
+#define MGMT_DELAY_MECHANISM                0x6000
+#define MGMT_LOG_MIN_PDELAY_REQ_INTERVAL    0x6001
+
+// --- managementErrorId values (IEEE 1588-2008 Table 72) ---
+#define MGMT_ERROR_NO_SUCH_ID               0x0002
+#define MGMT_ERROR_WRONG_LENGTH             0x0003
+#define MGMT_ERROR_WRONG_VALUE              0x0004
+#define MGMT_ERROR_NOT_SETABLE              0x0005
+#define MGMT_ERROR_NOT_SUPPORTED            0x0006
+
+#define MGMT_MAX_LEN        (MGMT_HEADER_LEN + 4 + 2 + MGMT_MAX_DATA_LEN)
+#define MGMT_REFRESH_TICKS  (PTP_TICK_RATE_HZ / 16) // One entry per refresh, whole cache in ~1 s
+#define MGMT_MIN_LOG_INTERVAL (-7)
+#define MGMT_MAX_LOG_INTERVAL 4
+
+// A cached, fully packed RESPONSE for one managementId
+typedef struct {
+    uint16_t id;
+    bool settable;
+    uint8_t len;
+    uint8_t response[MGMT_MAX_LEN];
+} mgmt_entry_t;
+
+// The managementIds answered, and whether SET may change them
+static const struct {
+    uint16_t id;
+    bool settable;
+} mgmt_ids[] = {
+    { .id = MGMT_NULL_MANAGEMENT,             .settable = FALSE },
+    { .id = MGMT_DEFAULT_DATA_SET,            .settable = FALSE },
+    { .id = MGMT_CURRENT_DATA_SET,            .settable = FALSE },
+    { .id = MGMT_PARENT_DATA_SET,             .settable = FALSE },
+    { .id = MGMT_TIME_PROPERTIES_DATA_SET,    .settable = FALSE },
+    { .id = MGMT_PORT_DATA_SET,               .settable = FALSE },
+    { .id = MGMT_PRIORITY1,                   .settable = TRUE },
+    { .id = MGMT_PRIORITY2,                   .settable = TRUE },
+    { .id = MGMT_DOMAIN,                      .settable = FALSE },
+    { .id = MGMT_SLAVE_ONLY,                  .settable = FALSE },
+    { .id = MGMT_LOG_ANNOUNCE_INTERVAL,       .settable = TRUE },
+    { .id = MGMT_ANNOUNCE_RECEIPT_TIMEOUT,    .settable = TRUE },
+    { .id = MGMT_LOG_SYNC_INTERVAL,           .settable = TRUE },
+    { .id = MGMT_VERSION_NUMBER,              .settable = FALSE },
+    { .id = MGMT_DELAY_MECHANISM,             .settable = FALSE },
+    { .id = MGMT_LOG_MIN_PDELAY_REQ_INTERVAL, .settable = FALSE },
+};
+
+#define MGMT_CACHE_ENTRIES  (sizeof(mgmt_ids) / sizeof(mgmt_ids[0]))
+
+PTP_ARENA static mgmt_entry_t mgmt_cache[MGMT_CACHE_ENTRIES];
+const uint32_t mgmt_arena_bytes = sizeof(mgmt_cache);
+
+static ptp_clock_t *mgmt_clock;
+static uint8_t refresh_index;
+static int32_t refresh_timer;
+
+// --- Helper Functions ---
+
+static void put16(uint8_t *buf, uint16_t val)
+{
+    buf[0] = (uint8_t)(val >> 8);
+    buf[1] = (uint8_t)val;
+}
+
+static void put32(uint8_t *buf, uint32_t val)
+{
+    put16(buf, (uint16_t)(val >> 16));
+    put16(buf + 2, (uint16_t)val);
+}
+
+/**
+ * @brief Pack a TimeInterval (scaled nanoseconds, 2^-16 ns).
+ */
+static void put_time_interval(uint8_t *buf, const TimeInternal *t)
+{
+    uint64_t scaled = (uint64_t)((t->seconds * 1000000000LL + t->nanoseconds) * 65536);
+
+    put32(buf, (uint32_t)(scaled >> 32));
+    put32(buf + 4, (uint32_t)scaled);
+}
+
+static void put_port_identity(uint8_t *buf, const PortIdentity *id)
+{
+    memcpy(buf, id->clockIdentity, 8);
+    put16(buf + 8, id->portNumber);
+}
+
+static void put_clock_quality(uint8_t *buf, const ClockQuality *q)
+{
+    buf[0] = q->clock_class;
+    buf[1] = q->clock_accuracy;
+    put16(buf + 2, q->offset_scaled_log_variance);
+}
+
+/**
+ * @brief currentDS.stepsRemoved: one more than our parent's.
+ */
+static uint16_t steps_removed(ptp_clock_t *clock)
+{
+    int i;
+
+    if (clock->port_ds.port_state != PTP_SLAVE && clock->port_ds.port_state != PTP_UNCALIBRATED) {
+        return 0;
+    }
+    for (i = 0; i < PTPD_DEFAULT_MAX_FOREIGN_RECORDS; ++i) {
+        if (memcmp(&clock->foreign[i].port_identity, &clock->parent_ds.parent_port_identity, sizeof(PortIdentity)) == 0) {
+            return clock->foreign[i].steps_removed + 1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Pack the dataField answering a GET of one managementId.
+ * @return Length of the dataField.
+ */
+static uint16_t pack_data(ptp_clock_t *clock, uint16_t id, uint8_t *data)
+{
+    TimeInternal peer_delay = { 0, 0 };
+    uint8_t flags;
+
+    memset(data, 0, MGMT_MAX_DATA_LEN);
+
+    switch (id) {
+        case MGMT_DEFAULT_DATA_SET:
+            data[0] = (clock->default_ds.two_step_flag ? 0x01 : 0) | (clock->default_ds.slave_only ? 0x02 : 0);
+            put16(data + 2, clock->default_ds.number_ports);
+            data[4] = clock->default_ds.priority1;
+            put_clock_quality(data + 5, &clock->default_ds.clock_quality);
+            data[9] = clock->default_ds.priority2;
+            memcpy(data + 10, clock->default_ds.clock_identity, 8);
+            data[18] = clock->default_ds.domain_number;
+            return 20;
+
+        case MGMT_CURRENT_DATA_SET:
+            put16(data, steps_removed(clock));
+            put_time_interval(data + 2, &clock->offset_from_master);
+            put_time_interval(data + 10, &clock->mean_path_delay);
+            return 18;
+
+        case MGMT_PARENT_DATA_SET:
+            put_port_identity(data, &clock->parent_ds.parent_port_identity);
+            data[10] = clock->parent_ds.parent_stats ? 0x01 : 0;
+            // Not computed: report the "unknown" values (IEEE 1588 8.2.3.5/8.2.3.6)
+            put16(data + 12, clock->parent_ds.parent_stats ? clock->parent_ds.observed_parent_offset_scaled_log_variance : 0xFFFF);
+            put32(data + 14, clock->parent_ds.parent_stats ? clock->parent_ds.observed_parent_clock_phase_change_rate : 0x7FFFFFFF);
+            data[18] = clock->parent_ds.grandmaster_priority1;
+            put_clock_quality(data + 19, &clock->parent_ds.grandmaster_clock_quality);
+            data[23] = clock->parent_ds.grandmaster_priority2;
+            memcpy(data + 24, clock->parent_ds.grandmaster_identity, 8);
+            return 32;
+
+        case MGMT_TIME_PROPERTIES_DATA_SET:
+            flags = (clock->time_properties_ds.leap61 ? 0x01 : 0) |
+                    (clock->time_properties_ds.leap59 ? 0x02 : 0) |
+                    (clock->time_properties_ds.current_utc_offset_valid ? 0x04 : 0) |
+                    (clock->time_properties_ds.ptp_timescale ? 0x08 : 0) |
+                    (clock->time_properties_ds.time_traceable ? 0x10 : 0) |
+                    (clock->time_properties_ds.frequency_traceable ? 0x20 : 0);
+            put16(data, (uint16_t)clock->time_properties_ds.current_utc_offset);
+            data[2] = flags;
+            data[3] = clock->time_properties_ds.time_source;
+            return 4;
+
+        case MGMT_PORT_DATA_SET:
+            if (clock->port_ds.delay_mechanism == PTP_DELAY_MECHANISM_P2P) {
+                peer_delay.nanoseconds = clock->path[clock->active_path].pdelay.mean_link_delay;
+            }
+            put_port_identity(data, &clock->port_ds.port_identity);
+            data[10] = (uint8_t)clock->port_ds.port_state + 1; // portState enumeration starts at 1
+            data[11] = (uint8_t)clock->port_ds.log_min_delay_req_interval;
+            put_time_interval(data + 12, &peer_delay);
+            data[20] = (uint8_t)clock->port_ds.log_announce_interval;
+            data[21] = clock->port_ds.announce_receipt_timeout;
+            data[22] = (uint8_t)clock->port_ds.log_sync_interval;
+            data[23] = clock->port_ds.delay_mechanism;
+            data[24] = (uint8_t)clock->port_ds.log_min_pdelay_req_interval;
+            data[25] = clock->port_ds.versionNumber & 0x0F;
+            return 26;
+
+        // Single-value IDs: value and one reserved octet
+        case MGMT_PRIORITY1:                    data[0] = clock->default_ds.priority1; return 2;
+        case MGMT_PRIORITY2:                    data[0] = clock->default_ds.priority2; return 2;
+        case MGMT_DOMAIN:                       data[0] = clock->default_ds.domain_number; return 2;
+        case MGMT_SLAVE_ONLY:                   data[0] = clock->default_ds.slave_only ? 0x01 : 0; return 2;
+        case MGMT_LOG_ANNOUNCE_INTERVAL:        data[0] = (uint8_t)clock->port_ds.log_announce_interval; return 2;
+        case MGMT_ANNOUNCE_RECEIPT_TIMEOUT:     data[0] = clock->port_ds.announce_receipt_timeout; return 2;
+        case MGMT_LOG_SYNC_INTERVAL:            data[0] = (uint8_t)clock->port_ds.log_sync_interval; return 2;
+        case MGMT_VERSION_NUMBER:               data[0] = clock->port_ds.versionNumber & 0x0F; return 2;
+        case MGMT_DELAY_MECHANISM:              data[0] = clock->port_ds.delay_mechanism; return 2;
+        case MGMT_LOG_MIN_PDELAY_REQ_INTERVAL:  data[0] = (uint8_t)clock->port_ds.log_min_pdelay_req_interval; return 2;
+
+        case MGMT_NULL_MANAGEMENT:
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Re-pack one cached response from the current data sets.
+ */
+static void refresh_entry(ptp_clock_t *clock, mgmt_entry_t *entry)
+{
+    uint8_t data[MGMT_MAX_DATA_LEN];
+    uint16_t data_len = pack_data(clock, entry->id, data);
+
+    entry->len = (uint8_t)msg_pack_management(entry->response, clock, MGMT_ACTION_RESPONSE,
+                                              TLV_MANAGEMENT, entry->id, data, data_len);
+}
+
+static mgmt_entry_t *find_entry(uint16_t id)
+{
+    uint8_t i;
+
+    for (i = 0; i < MGMT_CACHE_ENTRIES; ++i) {
+        if (mgmt_cache[i].id == id) {
+            return &mgmt_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Send a reply the way the request came: unicast or to the group.
+ */
+static void send_reply(uint8_t *buf, int len, const PtpHeader *req_header, uint8_t reply_hops)
+{
+    const ip_addr_t *requester = net_rx_addr();
+
+    msg_set_management_reply(buf, req_header, reply_hops);
+    if ((req_header->flags & 0x0400) && requester != NULL) {
+        msg_set_unicast(buf, req_header->sequenceId, 0x7F);
+        net_send_general_to(buf, len, requester);
+    } else {
+        net_send_general(buf, len);
+    }
+}
+
+static void send_error(const PtpHeader *req_header, uint8_t reply_hops, uint16_t management_id, uint16_t error_id)
+{
+    uint8_t buf[MGMT_MAX_LEN];
+    uint8_t error_n[2];
+    int len;
+
+    put16(error_n, error_id);
+    len = msg_pack_management(buf, mgmt_clock, MGMT_ACTION_RESPONSE, TLV_MANAGEMENT_ERROR_STATUS,
+                              management_id, error_n, sizeof(error_n));
+    send_reply(buf, len, req_header, reply_hops);
+}
+
+/**
+ * @brief Apply a SET.
+ *
+ * Changes go to the data sets and to ptp_opts, so they survive a
+ * re-initialization of the port. Interval changes take effect when the
+ * corresponding timer is next restarted.
+ *
+ * @return 0 on success, or the managementErrorId.
+ */
+static uint16_t apply_set(ptp_clock_t *clock, uint16_t id, const uint8_t *data, uint16_t data_len)
+{
+    int8_t value;
+
+    if (data_len != 2) {
+        return MGMT_ERROR_WRONG_LENGTH;
+    }
+    value = (int8_t)data[0];
+
+    switch (id) {
+        case MGMT_PRIORITY1:
+            clock->default_ds.priority1 = ptp_opts.priority1 = data[0];
+            clock->recommended_state = bmc(clock);
+            break;
+        case MGMT_PRIORITY2:
+            clock->default_ds.priority2 = ptp_opts.priority2 = data[0];
+            clock->recommended_state = bmc(clock);
+            break;
+        case MGMT_LOG_ANNOUNCE_INTERVAL:
+            if (value < MGMT_MIN_LOG_INTERVAL || value > MGMT_MAX_LOG_INTERVAL) {
+                return MGMT_ERROR_WRONG_VALUE;
+            }
+            clock->port_ds.log_announce_interval = ptp_opts.announce_interval = value;
+            break;
+        case MGMT_ANNOUNCE_RECEIPT_TIMEOUT:
+            if (data[0] < 2) {
+                return MGMT_ERROR_WRONG_VALUE;
+            }
+            clock->port_ds.announce_receipt_timeout = ptp_opts.announce_receipt_timeout = data[0];
+            break;
+        case MGMT_LOG_SYNC_INTERVAL:
+            if (value < MGMT_MIN_LOG_INTERVAL || value > MGMT_MAX_LOG_INTERVAL) {
+                return MGMT_ERROR_WRONG_VALUE;
+            }
+            clock->port_ds.log_sync_interval = ptp_opts.sync_interval = value;
+            break;
+        default:
+            return MGMT_ERROR_NOT_SETABLE;
+    }
+    return 0;
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Pack every cached response.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void mgmt_init(ptp_clock_t *clock)
+{
+    uint8_t i;
+
+    mgmt_clock = clock;
+    for (i = 0; i < MGMT_CACHE_ENTRIES; ++i) {
+        mgmt_cache[i].id = mgmt_ids[i].id;
+        mgmt_cache[i].settable = mgmt_ids[i].settable;
+        refresh_entry(clock, &mgmt_cache[i]);
+    }
+    refresh_index = 0;
+    refresh_timer = MGMT_REFRESH_TICKS;
+}
+
+/**
+ * @brief Refresh the next cached response, called every protocol tick.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void mgmt_tick(ptp_clock_t *clock)
+{
+    if (--refresh_timer > 0) {
+        return;
+    }
+    refresh_timer = MGMT_REFRESH_TICKS;
+
+    refresh_entry(clock, &mgmt_cache[refresh_index]);
+    if (++refresh_index >= MGMT_CACHE_ENTRIES) {
+        refresh_index = 0;
+    }
+}
+
+/**
+ * @brief Handle the MANAGEMENT TLV of a received Management message.
+ *
+ * GET is answered from the cache. A SET is applied and answered with the
+ * new value. COMMAND is not supported; RESPONSE and ACKNOWLEDGE from other
+ * nodes are ignored.
+ *
+ * @param header The header of the Management message.
+ * @param action The actionField.
+ * @param reply_hops Boundary hops for the response.
+ * @param management_id The managementId of the TLV.
+ * @param data The dataField of the TLV.
+ * @param data_len Length of @p data.
+ */
+void mgmt_handle(const PtpHeader *header, uint8_t action, uint8_t reply_hops,
+                 uint16_t management_id, const uint8_t *data, uint16_t data_len)
+{
+    mgmt_entry_t *entry;
+    uint8_t buf[MGMT_MAX_LEN];
+    uint16_t error;
+
+    if (mgmt_clock == NULL || header->domainNumber != mgmt_clock->default_ds.domain_number) {
+        return;
+    }
+
+    switch (action) {
+        case MGMT_ACTION_GET:
+        case MGMT_ACTION_SET:
+            break;
+        case MGMT_ACTION_COMMAND:
+            send_error(header, reply_hops, management_id, MGMT_ERROR_NOT_SUPPORTED);
+            return;
+        default:
+            return;
+    }
+
+    entry = find_entry(management_id);
+    if (entry == NULL) {
+        send_error(header, reply_hops, management_id, MGMT_ERROR_NO_SUCH_ID);
+        return;
+    }
+
+    if (action == MGMT_ACTION_SET) {
+        error = entry->settable ? apply_set(mgmt_clock, management_id, data, data_len) : MGMT_ERROR_NOT_SETABLE;
+        if (error != 0) {
+            send_error(header, reply_hops, management_id, error);
+            return;
+        }
+        mgmt_init(mgmt_clock); // A SET can change several data sets
+    }
+
+    memcpy(buf, entry->response, entry->len);
+    send_reply(buf, entry->len, header, reply_hops);
+}
+
+#endif /* PTP_SLAVE_ONLY */
@@ -0,0 +1,353 @@
+/**
+ * @file monitor.c
+ * @brief Passive monitoring of every grandmaster on the segment.
+ *
+ * With ptpd_opts.monitor set, every qualified master of our domain is
+ * watched, not only the parent: its Syncs (and Follow_Ups) are timestamped
+ * like the parent's and compared with the local clock. Nothing is sent to
+ * the watched masters, so their path delay is taken to be the parent's,
+ * as masters on one segment sit behind the same network. With the local
+ * clock locked to the parent, a backup grandmaster's offset is its offset
+ * from the parent, and its drift shows a failing oscillator or a lost GNSS
+ * fix long before a failover makes it our time source.
+ *
+ * Each master has one fixed record of PTP_MAX_MONITOR; a master that stops
+ * announcing frees its record.
+ */
+
+#include "../ptpd.h"
+
+extern ptpd_opts ptp_opts;
+extern sys_mbox_t ptp_alert_queue;
+
+#define MIN_QUALIFY_ANNOUNCES 2     // Announces needed before a master is watched
+#define ANNOUNCE_TIMEOUT    4       // Announce intervals before a master is dropped
+#define MONITOR_SHIFT       4       // Offset mean and PDV smoothing: weight 1/16 per Sync
+#define DRIFT_SYNCS         16      // Syncs between two drift estimates
+
+// --- Monitored Master Records ---
+typedef struct {
+    bool in_use;
+    bool waiting_for_followup;
+    uint8_t announce_count;         // Saturates at MIN_QUALIFY_ANNOUNCES
+    int8_t log_announce_interval;
+    uint16_t sync_sequence_id;
+    uint16_t window_count;          // Syncs in the current drift window
+    int64_t sync_correction;        // correctionField of the last Sync (2^-16 ns)
+    TimeInternal sync_receive_time;
+    TimeInternal last_announce;
+    TimeInternal window_start;      // T2 at the start of the drift window
+    int32_t window_mean;            // offset_mean_ns at the start of the drift window
+    ptp_monitor_stats_t stats;
+} monitor_entry_t;
+
+PTP_ARENA static monitor_entry_t monitored[PTP_MAX_MONITOR];
+const uint32_t monitor_arena_bytes = sizeof(monitored);
+
+
+// --- Helper Functions ---
+
+static int64_t time_to_ns(const TimeInternal *t)
+{
+    return t->seconds * 1000000000LL + t->nanoseconds;
+}
+
+static int64_t log_interval_to_ns(int8_t log_interval)
+{
+    if (log_interval >= 0) {
+        return 1000000000LL << log_interval;
+    }
+    return 1000000000LL >> -log_interval;
+}
+
+static bool same_port(const PortIdentity *a, const PortIdentity *b)
+{
+    return memcmp(a->clockIdentity, b->clockIdentity, 8) == 0 && a->portNumber == b->portNumber;
+}
+
+/**
+ * @brief Find the record of a qualified master of our domain.
+ * @return The record, or NULL if the sender is not watched.
+ */
+static monitor_entry_t *find_entry(ptp_clock_t *clock, const PtpHeader *header)
+{
+    int i;
+
+    if (header->domainNumber != clock->default_ds.domain_number) {
+        return NULL;
+    }
+    for (i = 0; i < PTP_MAX_MONITOR; ++i) {
+        monitor_entry_t *e = &monitored[i];
+        if (e->in_use && e->announce_count >= MIN_QUALIFY_ANNOUNCES &&
+            same_port(&e->stats.port_identity, &header->sourcePortIdentity)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Raise or clear a master's offset alarm, with hysteresis.
+ */
+static void check_alarm(monitor_entry_t *e)
+{
+    ptp_monitor_stats_t *s = &e->stats;
+    int32_t deviation = (s->offset_mean_ns < 0) ? -s->offset_mean_ns : s->offset_mean_ns;
+
+    // The parent's offset is the servo's business
+    if (s->is_parent || s->syncs < DRIFT_SYNCS) {
+        return;
+    }
+
+    if (!s->alarm && deviation > ptp_opts.monitor_alarm_ns) {
+        s->alarm = TRUE;
+        xil_printf("PTPd: Monitor: master %02x%02x%02x is %d ns off the local clock\r\n",
+            s->port_identity.clockIdentity[5], s->port_identity.clockIdentity[6],
+            s->port_identity.clockIdentity[7], s->offset_mean_ns);
+        sys_mbox_trypost(&ptp_alert_queue, (void *)(uintptr_t)PTP_ALERT_MONITOR_ALARM);
+    } else if (s->alarm && deviation < ptp_opts.monitor_alarm_ns / 2) {
+        s->alarm = FALSE;
+        xil_printf("PTPd: Monitor: master %02x%02x%02x agrees with the local clock again\r\n",
+            s->port_identity.clockIdentity[5], s->port_identity.clockIdentity[6],
+            s->port_identity.clockIdentity[7]);
+        sys_mbox_trypost(&ptp_alert_queue, (void *)(uintptr_t)PTP_ALERT_MONITOR_CLEARED);
+    }
+}
+
+/**
+ * @brief Complete one offset measurement towards a watched master.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param e The master's record.
+ * @param origin T1 of the Sync.
+ * @param correction The Sync's (and Follow_Up's) correctionField, 2^-16 ns.
+ */
+static void sample(ptp_clock_t *clock, monitor_entry_t *e, const TimeInternal *origin, int64_t correction)
+{
+    const ptp_path_t *path = &clock->path[clock->active_path];
+    ptp_monitor_stats_t *s = &e->stats;
+    int64_t t2 = time_to_ns(&e->sync_receive_time) - path->ingress_latency;
+    int64_t offset, pdv;
+
+    offset = t2 - time_to_ns(origin) - (correction >> 16) -
+             time_to_ns(&path->mean_path_delay) - path->delay_asymmetry;
+    if (offset > 0x7FFFFFFF) {
+        offset = 0x7FFFFFFF;
+    } else if (offset < -0x7FFFFFFF) {
+        offset = -0x7FFFFFFF;
+    }
+
+    s->offset_ns = (int32_t)offset;
+    s->is_parent = same_port(&s->port_identity, &clock->parent_ds.parent_port_identity);
+
+    if (s->syncs == 0) {
+        s->offset_mean_ns = s->offset_ns;
+        s->offset_min_ns = s->offset_ns;
+        s->offset_max_ns = s->offset_ns;
+        e->window_mean = s->offset_ns;
+        e->window_start = e->sync_receive_time;
+    } else {
+        s->offset_mean_ns += (int32_t)((offset - s->offset_mean_ns) >> MONITOR_SHIFT);
+        pdv = offset - s->offset_mean_ns;
+        if (pdv < 0) {
+            pdv = -pdv;
+        }
+        s->pdv_ns += (int32_t)((pdv - s->pdv_ns) >> MONITOR_SHIFT);
+        if (s->offset_ns < s->offset_min_ns) {
+            s->offset_min_ns = s->offset_ns;
+        }
+        if (s->offset_ns > s->offset_max_ns) {
+            s->offset_max_ns = s->offset_ns;
+        }
+    }
+    s->syncs++;
+
+    // Drift from the smoothed offset over a window of Syncs; single Syncs
+    // are too noisy to tell a frequency error from PDV
+    if (++e->window_count >= DRIFT_SYNCS) {
+        int64_t elapsed = time_to_ns(&e->sync_receive_time) - time_to_ns(&e->window_start);
+
+        if (elapsed > 0) {
+            s->drift_ppb = (int32_t)(((int64_t)s->offset_mean_ns - e->window_mean) * 1000000000LL / elapsed);
+        }
+        e->window_mean = s->offset_mean_ns;
+        e->window_start = e->sync_receive_time;
+        e->window_count = 0;
+    }
+
+    check_alarm(e);
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Forget all watched masters.
+ */
+void monitor_init(void)
+{
+    memset(monitored, 0, sizeof(monitored));
+}
+
+/**
+ * @brief Qualify a master announcing on our domain.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param header The header of the Announce message.
+ * @param announce The body of the Announce message.
+ */
+void monitor_announce(ptp_clock_t *clock, const PtpHeader *header, const AnnounceMessage *announce)
+{
+    monitor_entry_t *e = NULL;
+    monitor_entry_t *free_slot = NULL;
+    int i;
+
+    if (!ptp_opts.monitor) {
+        return;
+    }
+
+    for (i = 0; i < PTP_MAX_MONITOR; ++i) {
+        if (!monitored[i].in_use) {
+            if (free_slot == NULL) {
+                free_slot = &monitored[i];
+            }
+        } else if (same_port(&monitored[i].stats.port_identity, &header->sourcePortIdentity)) {
+            e = &monitored[i];
+            break;
+        }
+    }
+
+    if (e == NULL) {
+        if (free_slot == NULL) {
+            return; // Table full
+        }
+        e = free_slot;
+        memset(e, 0, sizeof(*e));
+        e->in_use = TRUE;
+        e->stats.port_identity = header->sourcePortIdentity;
+    }
+
+    memcpy(e->stats.grandmaster_identity, announce->grandmasterIdentity, 8);
+    e->stats.clock_class = announce->grandmasterClockQuality.clock_class;
+    e->log_announce_interval = header->logMessageInterval;
+    if (e->announce_count < MIN_QUALIFY_ANNOUNCES) {
+        e->announce_count++;
+    }
+    getTime(&e->last_announce);
+}
+
+/**
+ * @brief Timestamp a Sync from any watched master, the parent included.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param header The header of the Sync message.
+ * @param sync_receive_time T2, captured on arrival.
+ * @param origin_timestamp T1 for one-step masters.
+ */
+void monitor_sync(ptp_clock_t *clock, const PtpHeader *header, const TimeInternal *sync_receive_time,
+                  const TimeInternal *origin_timestamp)
+{
+    monitor_entry_t *e;
+    uint16_t diff;
+
+    if (!ptp_opts.monitor || (e = find_entry(clock, header)) == NULL) {
+        return;
+    }
+
+    diff = header->sequenceId - e->sync_sequence_id;
+    if (e->stats.syncs != 0 && diff > 1 && diff < SEQ_WINDOW) {
+        e->stats.lost += diff - 1;
+    }
+    e->sync_sequence_id = header->sequenceId;
+    e->sync_receive_time = *sync_receive_time;
+    e->sync_correction = header->correctionField;
+
+    if (!(header->flags & 0x0200)) { // 1-step clock
+        e->waiting_for_followup = FALSE;
+        sample(clock, e, origin_timestamp, e->sync_correction);
+    } else {
+        e->waiting_for_followup = TRUE;
+    }
+}
+
+/**
+ * @brief Complete the measurement of a two-step watched master.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param header The header of the Follow_Up message.
+ * @param precise_origin_timestamp T1.
+ */
+void monitor_follow_up(ptp_clock_t *clock, const PtpHeader *header, const TimeInternal *precise_origin_timestamp)
+{
+    monitor_entry_t *e;
+
+    if (!ptp_opts.monitor || (e = find_entry(clock, header)) == NULL) {
+        return;
+    }
+
+    if (e->waiting_for_followup && header->sequenceId == e->sync_sequence_id) {
+        e->waiting_for_followup = FALSE;
+        sample(clock, e, precise_origin_timestamp, e->sync_correction + header->correctionField);
+    }
+}
+
+/**
+ * @brief Drop masters whose Announces have stopped, called every protocol tick.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void monitor_tick(ptp_clock_t *clock)
+{
+    TimeInternal now;
+    int i;
+
+    if (!ptp_opts.monitor) {
+        return;
+    }
+
+    getTime(&now);
+    for (i = 0; i < PTP_MAX_MONITOR; ++i) {
+        monitor_entry_t *e = &monitored[i];
+
+        if (e->in_use && time_to_ns(&now) - time_to_ns(&e->last_announce) >
+                         ANNOUNCE_TIMEOUT * log_interval_to_ns(e->log_announce_interval)) {
+            xil_printf("PTPd: Monitor: master %02x%02x%02x timed out\r\n",
+                e->stats.port_identity.clockIdentity[5], e->stats.port_identity.clockIdentity[6],
+                e->stats.port_identity.clockIdentity[7]);
+            e->in_use = FALSE;
+        }
+    }
+}
+
+/**
+ * @brief Read the statistics of one watched master.
+ * @param index 0 to PTP_MAX_MONITOR - 1.
+ * @param stats Receives the statistics.
+ * @return TRUE if a master is watched in that record, FALSE otherwise.
+ */
+bool monitor_get_stats(uint8_t index, ptp_monitor_stats_t *stats)
+{
+    if (index >= PTP_MAX_MONITOR || !monitored[index].in_use) {
+        return FALSE;
+    }
+    *stats = monitored[index].stats;
+    return TRUE;
+}
+
+/**
+ * @brief Print the statistics of every watched master.
+ */
+void monitor_print_stats(void)
+{
+    int i;
+
+    for (i = 0; i < PTP_MAX_MONITOR; ++i) {
+        const ptp_monitor_stats_t *s = &monitored[i].stats;
+
+        if (!monitored[i].in_use) {
+            continue;
+        }
+        xil_printf("PTPd: Monitor: %02x%02x%02x%02x%02x%02x%02x%02x class %d%s: offset %d ns (mean %d, min %d, max %d), "
+                   "PDV %d ns, drift %d ppb, syncs %d, lost %d%s\r\n",
+            s->port_identity.clockIdentity[0], s->port_identity.clockIdentity[1], s->port_identity.clockIdentity[2],
+            s->port_identity.clockIdentity[3], s->port_identity.clockIdentity[4], s->port_identity.clockIdentity[5],
+            s->port_identity.clockIdentity[6], s->port_identity.clockIdentity[7], s->clock_class,
+            s->is_parent ? " (parent)" : "", s->offset_ns, s->offset_mean_ns, s->offset_min_ns, s->offset_max_ns,
+            s->pdv_ns, s->drift_ppb, s->syncs, s->lost, s->alarm ? ", ALARM" : "");
+    }
+}
@@ -1,8 +1,24 @@
 #include "../ptpd.h"
+#include "lwip/igmp.h"
+#if LWIP_IPV6
+#include "lwip/mld6.h"
+#endif
+#include "netif/ethernet.h" // ethernet_output() for PTP over IEEE 802.3
+#include "netif/xaxiemacif.h" // AXI Ethernet adapter state (MAC address filter)
 
 // --- Global PTP Data Structures ---
 // These are defined in main.c and used here.
 extern ptp_clock_t ptp_clock;
+extern ptpd_opts ptp_opts;
+
+// --- Network Interfaces (Redundant Paths) ---
+// Index n is path n in ptp_clock.path[]. Filled by ptpd_net_add_interface(),
+// or with netif_default if the application registers none.
+static struct netif *ptp_netifs[PTP_MAX_PATHS];
+static uint8_t ptp_num_netifs;
+static uint8_t current_rx_path; // Path of the message being handled
+static ip_addr_t current_rx_addr; // Source of the message being handled (UDP only)
+static bool current_rx_addr_valid;
 
 // --- lwIP UDP Protocol Control Blocks (PCBs) ---
 static struct udp_pcb *ptp_event_pcb;
@@ -11,10 +27,122 @@ static struct udp_pcb *ptp_general_pcb;
 // --- PTP Multicast Addresses ---
 static const ip_addr_t ptp_primary_multicast   = PTP_PRIMARY_MULTICAST_IP;
 static const ip_addr_t ptp_peer_multicast      = PTP_PEER_MULTICAST_IP;
+#if LWIP_IPV6
+static const ip_addr_t ptp_primary_multicast6  = PTP_PRIMARY_MULTICAST_IP6;
+static const ip_addr_t ptp_peer_multicast6     = PTP_PEER_MULTICAST_IP6;
+#endif
+
+// --- PTP Multicast MAC Addresses (IEEE 1588-2008 Annex D, E and F) ---
+// Each entry is one slot in the EMAC multicast address filter. The index is
+// also the index into ptp_mcast_filter_stats_t.group_hits.
+typedef struct {
+    uint8_t group;       // PTP_MCAST_GROUPS_* selector
+    const char *name;
+    uint8_t mac[6];
+} ptp_mcast_filter_entry_t;
+
+static const ptp_mcast_filter_entry_t ptp_mcast_filter[PTP_MCAST_FILTER_ENTRIES] = {
+    { PTP_MCAST_GROUPS_IPV4, "IPv4 224.0.1.129", { 0x01, 0x00, 0x5e, 0x00, 0x01, 0x81 } },
+    { PTP_MCAST_GROUPS_IPV4, "IPv4 224.0.0.107", { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x6b } },
+    { PTP_MCAST_GROUPS_IPV6, "IPv6 FF0E::181",   { 0x33, 0x33, 0x00, 0x00, 0x01, 0x81 } },
+    { PTP_MCAST_GROUPS_IPV6, "IPv6 FF02::6B",    { 0x33, 0x33, 0x00, 0x00, 0x00, 0x6b } },
+    { PTP_MCAST_GROUPS_L2,   "L2 primary",       { 0x01, 0x1b, 0x19, 0x00, 0x00, 0x00 } },
+    { PTP_MCAST_GROUPS_L2,   "L2 peer delay",    { 0x01, 0x80, 0xc2, 0x00, 0x00, 0x0e } },
+};
+
+#define MCAST_ENTRY_IPV4_PRIMARY 0
+#define MCAST_ENTRY_IPV4_PEER    1
+#define MCAST_ENTRY_IPV6_PRIMARY 2
+#define MCAST_ENTRY_IPV6_PEER    3
+#define MCAST_ENTRY_L2_PRIMARY   4
+#define MCAST_ENTRY_L2_PEER      5
+
+// Unicast PTP (G.8275.2) may arrive over IPv6 as well when lwIP has it
+#if LWIP_IPV6
+#define PTP_BIND_ADDR            IP_ANY_TYPE
+#else
+#define PTP_BIND_ADDR            IP_ADDR_ANY
+#endif
+
+static ptp_mcast_filter_stats_t mcast_filter_stats[PTP_MAX_PATHS]; // Per path, each MAC has its own filter
+
+// --- 802.1Q Tag Fields ---
+#define VLAN_PCP_SHIFT  13
+#define VLAN_VID_MASK   0x0FFF
+#define VLAN_NO_TAG     (-1)  // LWIP_HOOK_VLAN_SET return value for untagged frames
+
+// --- Egress Timestamping ---
+// The MAC driver's transmit function, wrapped by ptp_linkoutput() so event
+// messages are timestamped as the frame is handed to the DMA.
+static netif_linkoutput_fn mac_linkoutput[PTP_MAX_PATHS];
+static TimeInternal last_tx_timestamp;
+static bool last_tx_timestamp_valid;
+static bool udp_csum_in_hw[PTP_MAX_PATHS];
+
+// --- PTP over IEEE 802.3 (gPTP, G.8275.1) and NTP ---
+// The driver's receive function, wrapped by ptp_input() on every PTP
+// interface so every frame gets its receive time before lwIP sees it, and
+// frames with the PTP EtherType reach handle_msg() without passing through lwIP.
+static netif_input_fn mac_input[PTP_MAX_PATHS];
+static TimeInternal last_rx_timestamp;
+static bool last_rx_timestamp_valid;
+
+// --- Transmit Buffers ---
+// Messages leave in lwIP custom pbufs over this static pool instead of
+// pbufs from the lwIP heap. A buffer returns to the pool when the driver
+// frees its pbuf, which with the DMA driver is on TX completion.
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error "The PTP transmit buffers need LWIP_SUPPORT_CUSTOM_PBUF in lwipopts.h"
+#endif
+#define PTP_TX_HEADROOM (PBUF_LINK_ENCAPSULATION_HLEN + PBUF_LINK_HLEN + PBUF_IP_HLEN + PBUF_TRANSPORT_HLEN)
+
+typedef struct {
+    struct pbuf_custom pc;  // Must be first, lwIP hands back the pbuf
+    volatile bool in_use;   // Cleared by tx_buffer_free(), possibly in the TX interrupt
+    uint8_t data[PTP_TX_HEADROOM + PTP_TX_BUFFER_SIZE] __attribute__((aligned(4)));
+} ptp_tx_buffer_t;
+
+// PTP messages and the datagrams of other services (NTP) draw from
+// separate pools, so a burst of NTP clients cannot starve the Syncs.
+typedef struct {
+    ptp_tx_buffer_t *buffers;
+    uint8_t count;
+    bool report;            // Print when the pool runs dry (PTP), or only count (NTP)
+    uint32_t exhausted;     // Allocations that found every buffer taken
+} ptp_tx_pool_t;
+
+PTP_ARENA static ptp_tx_buffer_t tx_buffers[PTP_TX_BUFFERS];
+PTP_ARENA static ptp_tx_buffer_t udp_tx_buffers[PTP_UDP_TX_BUFFERS];
+const uint32_t net_arena_bytes = sizeof(tx_buffers) + sizeof(udp_tx_buffers);
+
+static ptp_tx_pool_t ptp_tx_pool = { tx_buffers, PTP_TX_BUFFERS, TRUE, 0 };
+static ptp_tx_pool_t udp_tx_pool = { udp_tx_buffers, PTP_UDP_TX_BUFFERS, FALSE, 0 };
+
+#define ETH_HDR_LEN         14
+#define ETH_TYPE_VLAN       0x8100
+#define ETH_TYPE_IPV4       0x0800
+#define ETH_TYPE_IPV6       0x86DD
+#define IPV6_HDR_LEN        40
+#define UDP_HDR_LEN         8
+#define UDP_CSUM_OFFSET     6
+#define PTP_FLAG_TWO_STEP   0x02 // In the first octet of the flags field
+#define PTP_TIMESTAMP_LEN   10
+#define PTP_TIMESTAMP_OFFSET 34  // originTimestamp within the PTP message
 
 // --- Function Prototypes ---
 static void ptp_event_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port);
 static void ptp_general_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port);
+static bool net_program_mcast_filter(struct netif *netif, uint8_t index, uint8_t groups);
+static void net_count_filter_hit(void);
+static XAxiEthernet *net_get_axi(struct netif *netif);
+static void net_configure_priority(struct netif *netif);
+static void net_configure_checksum(struct netif *netif, uint8_t index);
+static void net_setup_interface(struct netif *netif, uint8_t index);
+static int net_netif_index(const struct netif *netif);
+static err_t ptp_linkoutput(struct netif *netif, struct pbuf *p);
+static err_t ptp_input(struct pbuf *p, struct netif *netif);
+static void net_count_l2_filter_hit(const uint8_t *dst);
+static struct pbuf *tx_buffer_alloc(ptp_tx_pool_t *pool, pbuf_layer layer, const void *data, int len, int reserve);
 
 
 /**
@@ -31,6 +159,7 @@ static void ptp_general_recv_callback(void *arg, struct udp_pcb *pcb, struct pbu
 bool ptpd_net_init(net_path_t *net_path)
 {
     err_t err;
+    uint8_t i;
 
     xil_printf("PTPd: Initializing network layer...\r\n");
 
@@ -42,7 +171,7 @@ bool ptpd_net_init(net_path_t *net_path)
     }
 
     // Bind to the PTP event port
-    err = udp_bind(ptp_event_pcb, IP_ADDR_ANY, PTP_EVENT_PORT);
+    err = udp_bind(ptp_event_pcb, PTP_BIND_ADDR, PTP_EVENT_PORT);
     if (err != ERR_OK) {
         xil_printf("PTPd: ERROR: Failed to bind Event PCB (err: %d)\r\n");
         udp_remove(ptp_event_pcb);
@@ -58,7 +187,7 @@ bool ptpd_net_init(net_path_t *net_path)
     }
 
     // Bind to the PTP general port
-    err = udp_bind(ptp_general_pcb, IP_ADDR_ANY, PTP_GENERAL_PORT);
+    err = udp_bind(ptp_general_pcb, PTP_BIND_ADDR, PTP_GENERAL_PORT);
     if (err != ERR_OK) {
         xil_printf("PTPd: ERROR: Failed to bind General PCB (err: %d)\r\n");
         udp_remove(ptp_event_pcb);
@@ -66,24 +195,24 @@ bool ptpd_net_init(net_path_t *net_path)
         return FALSE;
     }
 
-    // 3. Join PTP Multicast Groups
-    // Use the default network interface for multicast
-    struct netif* default_netif = netif_default;
-
-    err = igmp_joingroup(&default_netif->ip_addr, &ptp_primary_multicast);
-    if (err != ERR_OK) {
-        xil_printf("PTPd: ERROR: Failed to join primary multicast group (err: %d)\r\n");
+    // 3. Join the PTP groups and configure the MAC on every path
+    if (ptp_num_netifs == 0) {
+        ptp_netifs[ptp_num_netifs++] = netif_default;
     }
-
-    err = igmp_joingroup(&default_netif->ip_addr, &ptp_peer_multicast);
-    if (err != ERR_OK) {
-        xil_printf("PTPd: ERROR: Failed to join peer multicast group (err: %d)\r\n");
+    for (i = 0; i < ptp_num_netifs; ++i) {
+        net_setup_interface(ptp_netifs[i], i);
     }
+    path_init(&ptp_clock, ptp_num_netifs);
 
     // 4. Register UDP Receive Callbacks
     udp_recv(ptp_event_pcb, ptp_event_recv_callback, &ptp_clock);
     udp_recv(ptp_general_pcb, ptp_general_recv_callback, &ptp_clock);
 
+    // 5. Serve NTP from the disciplined clock
+    if (ptp_opts.ntp_server) {
+        ntp_init(&ptp_clock);
+    }
+
     xil_printf("PTPd: Network layer initialized successfully.\r\n");
     return TRUE;
 }
@@ -103,36 +232,796 @@ void ptpd_net_shutdown(net_path_t *net_path)
     }
 }
 
+/**
+ * @brief Register an additional network interface for redundant PTP paths.
+ *
+ * Must be called before ptpd_net_init(). Interfaces become paths 0, 1, ...
+ * in registration order; path 0 is the initially active one.
+ *
+ * @param netif An initialized lwIP network interface.
+ * @return TRUE on success, FALSE if PTP_MAX_PATHS interfaces are registered.
+ */
+bool ptpd_net_add_interface(struct netif *netif)
+{
+    if (ptp_num_netifs >= PTP_MAX_PATHS) {
+        xil_printf("PTPd: ERROR: Too many PTP interfaces\r\n");
+        return FALSE;
+    }
+    ptp_netifs[ptp_num_netifs++] = netif;
+    return TRUE;
+}
+
+/**
+ * @brief Join the PTP groups on one interface and configure its MAC.
+ * @param netif The network interface.
+ * @param index The path index of the interface.
+ */
+static void net_setup_interface(struct netif *netif, uint8_t index)
+{
+    err_t err;
+
+    // Timestamp every frame on arrival, before any protocol processing.
+    // PTP directly on Ethernet: take PTP frames off the receive path too.
+    if (mac_input[index] == NULL) {
+        mac_input[index] = netif->input;
+        netif->input = ptp_input;
+    }
+    if (ptp_opts.transport != PTP_TRANSPORT_L2 && !ptp_opts.unicast) {
+        err = igmp_joingroup(&netif->ip_addr, &ptp_primary_multicast);
+        if (err != ERR_OK) {
+            xil_printf("PTPd: ERROR: Failed to join primary multicast group (err: %d)\r\n", err);
+        }
+
+        err = igmp_joingroup(&netif->ip_addr, &ptp_peer_multicast);
+        if (err != ERR_OK) {
+            xil_printf("PTPd: ERROR: Failed to join peer multicast group (err: %d)\r\n", err);
+        }
+    }
+#if LWIP_IPV6
+    // The IPv6 groups through MLD, or lwIP drops what the MAC lets through
+    if (ptp_opts.transport != PTP_TRANSPORT_L2 && !ptp_opts.unicast && (ptp_opts.mcast_groups & PTP_MCAST_GROUPS_IPV6)) {
+        err = mld6_joingroup_netif(netif, ip_2_ip6(&ptp_primary_multicast6));
+        if (err != ERR_OK) {
+            xil_printf("PTPd: ERROR: Failed to join IPv6 primary multicast group (err: %d)\r\n", err);
+        }
+
+        err = mld6_joingroup_netif(netif, ip_2_ip6(&ptp_peer_multicast6));
+        if (err != ERR_OK) {
+            xil_printf("PTPd: ERROR: Failed to join IPv6 peer multicast group (err: %d)\r\n", err);
+        }
+    }
+#endif
+
+    // Restrict the MAC's multicast filter to the PTP groups only, so other
+    // multicast traffic on the segment is dropped before it reaches the CPU.
+    if (!net_program_mcast_filter(netif, index, ptp_opts.mcast_groups)) {
+        xil_printf("PTPd: WARNING: MAC multicast filter not configured\r\n");
+    }
+
+    // Mark outgoing PTP traffic for priority queuing in switches
+    net_configure_priority(netif);
+
+    // Choose how UDP checksums are produced and hook the egress path so
+    // event messages are timestamped as late as possible.
+    net_configure_checksum(netif, index);
+    if (mac_linkoutput[index] == NULL) {
+        mac_linkoutput[index] = netif->linkoutput;
+        netif->linkoutput = ptp_linkoutput;
+    }
+
+    xil_printf("PTPd: Path %d on interface %c%c%d\r\n", index, netif->name[0], netif->name[1], netif->num);
+}
+
+/**
+ * @brief Map an lwIP netif to its PTP path index.
+ * @return The path index, or -1 if the interface is not used by PTP.
+ */
+static int net_netif_index(const struct netif *netif)
+{
+    int i;
+
+    for (i = 0; i < ptp_num_netifs; ++i) {
+        if (ptp_netifs[i] == netif) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Get the path the message currently being handled was received on.
+ *
+ * Only meaningful while handle_msg() is running from a receive callback.
+ */
+uint8_t net_rx_path(void)
+{
+    return current_rx_path;
+}
+
+/**
+ * @brief Get the source address of the message currently being handled.
+ *
+ * Only meaningful while handle_msg() is running from a receive callback.
+ *
+ * @return The sender's IP address, or NULL for PTP over Ethernet.
+ */
+const ip_addr_t *net_rx_addr(void)
+{
+    return current_rx_addr_valid ? &current_rx_addr : NULL;
+}
+
+/**
+ * @brief Check whether a path's Ethernet link is up.
+ * @param path The path index.
+ */
+bool net_path_link_up(uint8_t path)
+{
+    if (path >= ptp_num_netifs) {
+        return FALSE;
+    }
+    return netif_is_up(ptp_netifs[path]) && netif_is_link_up(ptp_netifs[path]);
+}
+
+/**
+ * @brief Get the AXI Ethernet driver instance behind an lwIP netif.
+ */
+static XAxiEthernet *net_get_axi(struct netif *netif)
+{
+    xemacif_s *emac = (xemacif_s *)netif->state;
+    xaxiemacif_s *xaxiemacif = (xaxiemacif_s *)emac->state;
+    return &xaxiemacif->axi_ethernet;
+}
+
+/**
+ * @brief Program the EMAC multicast address filter with the PTP groups.
+ *
+ * The AXI Ethernet MAC drops multicast frames whose destination is not in
+ * its address filter. Only the groups selected by @p groups are programmed,
+ * so unrelated multicast (video, telemetry, mDNS...) never raises an
+ * interrupt or consumes a receive buffer. The groups lwIP already had the
+ * driver program (224.0.0.1, the IPv6 all-nodes and solicited-node groups)
+ * are kept ahead of them: without those the IGMP/MLD queries are dropped,
+ * lwIP stops reporting its memberships, and snooping switches prune the PTP
+ * groups. The extended multicast filter is used when the core has it;
+ * otherwise the 4-entry CAM is filled in that order and any group that does
+ * not fit is reported.
+ *
+ * @param netif The network interface the PTP groups were joined on.
+ * @param index The path index of the interface.
+ * @param groups Bitmask of PTP_MCAST_GROUPS_* to accept.
+ * @return TRUE if every requested group was programmed, FALSE otherwise.
+ */
+static bool net_program_mcast_filter(struct netif *netif, uint8_t index, uint8_t groups)
+{
+    ptp_mcast_filter_stats_t *stats = &mcast_filter_stats[index];
+    XAxiEthernet *axi = net_get_axi(netif);
+    bool use_ext = XAxiEthernet_IsExtMcast(axi);
+    bool all_programmed = TRUE;
+    uint8_t joined[XAE_MULTI_MAT_ENTRIES][6];
+    int num_joined = 0;
+    int cam_entry = 0;
+    int i, j;
+
+    memset(stats, 0, sizeof(*stats));
+
+    // The filter may only be changed while the MAC is stopped
+    XAxiEthernet_Stop(axi);
+
+    // Collect lwIP's groups; PTP entries are rebuilt from @p groups below
+    for (i = 0; i < XAE_MULTI_MAT_ENTRIES; ++i) {
+        uint8_t mac[6];
+        bool ptp_group = FALSE;
+
+        XAxiEthernet_MulticastGet(axi, mac, i);
+        for (j = 0; j < PTP_MCAST_FILTER_ENTRIES; ++j) {
+            ptp_group |= (memcmp(mac, ptp_mcast_filter[j].mac, 6) == 0);
+        }
+        if ((mac[0] & 0x01) && !ptp_group) {
+            memcpy(joined[num_joined++], mac, 6);
+        }
+        XAxiEthernet_MulticastClear(axi, i);
+    }
+
+    for (i = 0; i < num_joined; ++i) {
+        int status = use_ext ? XAxiEthernet_AddExtMulticastGroup(axi, joined[i]) :
+                               XAxiEthernet_MulticastAdd(axi, joined[i], cam_entry++);
+
+        if (status != XST_SUCCESS) {
+            xil_printf("PTPd: ERROR: Lost MAC filter entry %02x:%02x:%02x:%02x:%02x:%02x\r\n",
+                joined[i][0], joined[i][1], joined[i][2], joined[i][3], joined[i][4], joined[i][5]);
+            all_programmed = FALSE;
+        }
+    }
+
+    for (i = 0; i < PTP_MCAST_FILTER_ENTRIES; ++i) {
+        const ptp_mcast_filter_entry_t *entry = &ptp_mcast_filter[i];
+        int status;
+
+        if (!(groups & entry->group)) {
+            continue;
+        }
+
+        if (use_ext) {
+            status = XAxiEthernet_AddExtMulticastGroup(axi, (void *)entry->mac);
+        } else if (cam_entry < XAE_MULTI_MAT_ENTRIES) {
+            status = XAxiEthernet_MulticastAdd(axi, (void *)entry->mac, cam_entry++);
+        } else {
+            status = XST_FAILURE;
+        }
+
+        if (status == XST_SUCCESS) {
+            stats->programmed_mask |= (1 << i);
+            xil_printf("PTPd: MAC filter: %s (%02x:%02x:%02x:%02x:%02x:%02x)\r\n", entry->name,
+                entry->mac[0], entry->mac[1], entry->mac[2], entry->mac[3], entry->mac[4], entry->mac[5]);
+        } else {
+            xil_printf("PTPd: ERROR: No MAC filter slot for %s\r\n", entry->name);
+            all_programmed = FALSE;
+        }
+    }
+
+    // Accept only listed groups: filter on, promiscuous off
+    XAxiEthernet_ClearOptions(axi, XAE_PROMISC_OPTION);
+    XAxiEthernet_SetOptions(axi, use_ext ? (XAE_MULTICAST_OPTION | XAE_EXT_MULTICAST_OPTION) : XAE_MULTICAST_OPTION);
+    XAxiEthernet_Start(axi);
+
+    stats->hw_filter_active = (stats->programmed_mask != 0);
+    return all_programmed;
+}
+
+/**
+ * @brief Configure DSCP marking and VLAN tagging of outgoing PTP messages.
+ *
+ * Event and general messages use separate PCBs, so the DSCP of each class is
+ * simply the TOS of its PCB. VLAN tags are inserted by ptpd_vlan_set_hook(),
+ * wired into lwIP by ptpd_lwip_hooks.h; here the MAC is only told to accept
+ * tagged (4 bytes longer) frames.
+ *
+ * @param netif The network interface PTP is bound to.
+ */
+static void net_configure_priority(struct netif *netif)
+{
+    ptp_event_pcb->tos = (uint8_t)(ptp_opts.dscp_event << 2);
+    ptp_general_pcb->tos = (uint8_t)(ptp_opts.dscp_general << 2);
+
+    if (ptp_opts.vlan_id != PTP_VLAN_NONE) {
+        XAxiEthernet *axi = net_get_axi(netif);
+
+        XAxiEthernet_Stop(axi);
+        XAxiEthernet_SetOptions(axi, XAE_VLAN_OPTION);
+        XAxiEthernet_Start(axi);
+#if !ETHARP_SUPPORT_VLAN
+        xil_printf("PTPd: WARNING: lwIP built without ETHARP_SUPPORT_VLAN, frames leave untagged (see ptpd_lwip_hooks.h)\r\n");
+#endif
+    }
+
+    xil_printf("PTPd: DSCP event %d / general %d, VLAN %d PCP %d / %d\r\n",
+        ptp_opts.dscp_event, ptp_opts.dscp_general, ptp_opts.vlan_id,
+        ptp_opts.vlan_pcp_event, ptp_opts.vlan_pcp_general);
+}
+
+/**
+ * @brief lwIP VLAN hook: choose the 802.1Q tag for an outgoing frame.
+ *
+ * Called by ethernet_output() for every frame with p->payload at the start
+ * of the Ethernet payload. With a VLAN configured, every frame sent on a
+ * PTP interface is tagged, ARP and NTP included: on a tagged-only VLAN a
+ * unicast peer could not even be resolved otherwise. PTP over UDP is
+ * recognised by its destination port (319 = event, 320 = general) and PTP
+ * over Ethernet by its EtherType and messageType nibble, and gets the PTP
+ * priorities; all other traffic is sent with priority 0.
+ *
+ * @return (PCP << 13 | VID) to insert a tag, or -1 to send untagged.
+ */
+s32_t ptpd_vlan_set_hook(struct netif *netif, struct pbuf *p, const struct eth_addr *src, const struct eth_addr *dst, u16_t eth_type)
+{
+    const uint8_t *frame = (const uint8_t *)p->payload;
+    s32_t other = ptp_opts.vlan_id & VLAN_VID_MASK; // Tag of non-PTP frames, PCP 0
+    bool is_event;
+
+    if (ptp_opts.vlan_id == PTP_VLAN_NONE || net_netif_index(netif) < 0) {
+        return VLAN_NO_TAG;
+    }
+
+    if (eth_type == PTP_ETHERTYPE) {
+        // Event messages have messageType 0x0-0x7
+        is_event = (p->len >= 1) && ((frame[0] & 0x0F) < 0x08);
+    } else if (eth_type == ETH_TYPE_IPV4 || eth_type == ETH_TYPE_IPV6) {
+        uint16_t ihl, dst_port;
+
+        if (eth_type == ETH_TYPE_IPV4) {
+            if (p->len < 20 || frame[9] != 17) { // Not UDP
+                return other;
+            }
+            ihl = (frame[0] & 0x0F) * 4;
+        } else {
+            if (p->len < IPV6_HDR_LEN || frame[6] != 17) { // Not UDP (or has extension headers)
+                return other;
+            }
+            ihl = IPV6_HDR_LEN;
+        }
+        if (p->len < ihl + 4) {
+            return other;
+        }
+        dst_port = ((uint16_t)frame[ihl + 2] << 8) | frame[ihl + 3];
+        if (dst_port == PTP_EVENT_PORT) {
+            is_event = TRUE;
+        } else if (dst_port == PTP_GENERAL_PORT) {
+            is_event = FALSE;
+        } else {
+            return other;
+        }
+    } else {
+        return other; // ARP and everything else
+    }
+
+    return ((s32_t)((is_event ? ptp_opts.vlan_pcp_event : ptp_opts.vlan_pcp_general) & 0x07) << VLAN_PCP_SHIFT) |
+           (ptp_opts.vlan_id & VLAN_VID_MASK);
+}
+
+/**
+ * @brief Select the UDP checksum strategy for transmitted PTP messages.
+ *
+ * PTP_UDP_CSUM_OFFLOAD disables lwIP's software UDP checksum when the MAC can
+ * compute full checksums on transmit and the xaxiemacif driver is built to
+ * ask for them (LWIP_FULL_CSUM_OFFLOAD_TX in the BSP's lwIP settings);
+ * otherwise software checksums are kept. Without the driver setting the
+ * frames of every UDP user on the netif would leave with a zero checksum,
+ * which IPv6 forbids.
+ * PTP_UDP_CSUM_ZERO_EVENT sends IPv4 event messages without a checksum, which
+ * IPv4 permits and which keeps any later timestamp insertion trivially valid.
+ *
+ * @param netif The network interface PTP is bound to.
+ * @param index The path index of the interface.
+ */
+static void net_configure_checksum(struct netif *netif, uint8_t index)
+{
+    udp_csum_in_hw[index] = FALSE;
+
+    switch (ptp_opts.udp_checksum) {
+    case PTP_UDP_CSUM_OFFLOAD:
+#if LWIP_CHECKSUM_CTRL_PER_NETIF && defined(LWIP_FULL_CSUM_OFFLOAD_TX) && LWIP_FULL_CSUM_OFFLOAD_TX
+        if (XAxiEthernet_IsTxFullCsum(net_get_axi(netif))) {
+            NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL & ~NETIF_CHECKSUM_GEN_UDP);
+            udp_csum_in_hw[index] = TRUE;
+        }
+#endif
+        if (!udp_csum_in_hw[index]) {
+            xil_printf("PTPd: WARNING: No TX checksum offload, using software checksums\r\n");
+        }
+        break;
+    case PTP_UDP_CSUM_ZERO_EVENT:
+        udp_setflags(ptp_event_pcb, udp_flags(ptp_event_pcb) | UDP_FLAGS_NOCHKSUM);
+        break;
+    case PTP_UDP_CSUM_SOFTWARE:
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Incrementally update a UDP checksum after payload bytes changed (RFC 1624).
+ *
+ * @param udp_hdr Start of the UDP header; its checksum field is updated in place.
+ * @param offset Offset of the changed bytes from the UDP header (must be even).
+ * @param old_data The bytes that were covered by the current checksum.
+ * @param len Number of changed bytes (must be even).
+ */
+static void udp_checksum_update(uint8_t *udp_hdr, int offset, const uint8_t *old_data, int len)
+{
+    uint32_t sum = (uint16_t)~(((uint16_t)udp_hdr[UDP_CSUM_OFFSET] << 8) | udp_hdr[UDP_CSUM_OFFSET + 1]);
+    int i;
+
+    for (i = 0; i < len; i += 2) {
+        sum += (uint16_t)~(((uint16_t)old_data[i] << 8) | old_data[i + 1]);
+        sum += ((uint16_t)udp_hdr[offset + i] << 8) | udp_hdr[offset + i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    sum = (uint16_t)~sum;
+    if (sum == 0) {
+        sum = 0xFFFF; // 0 means "no checksum" in UDP
+    }
+    udp_hdr[UDP_CSUM_OFFSET] = (uint8_t)(sum >> 8);
+    udp_hdr[UDP_CSUM_OFFSET + 1] = (uint8_t)sum;
+}
+
+/**
+ * @brief Write the transmit timestamp of an outgoing NTP response.
+ * @param netif The interface the frame leaves on.
+ * @param udp_hdr The UDP header of the response.
+ */
+static void net_stamp_ntp(struct netif *netif, uint8_t *udp_hdr)
+{
+    uint8_t old_ts[8];
+    uint8_t *ts = udp_hdr + UDP_HDR_LEN + NTP_OFF_TRANSMIT;
+    TimeInternal now;
+
+    memcpy(old_ts, ts, 8);
+    getTime(&now);
+    ntp_pack_timestamp(ts, &now);
+
+    if (!udp_csum_in_hw[net_netif_index(netif)] && (udp_hdr[UDP_CSUM_OFFSET] | udp_hdr[UDP_CSUM_OFFSET + 1]) != 0) {
+        udp_checksum_update(udp_hdr, UDP_HDR_LEN + NTP_OFF_TRANSMIT, old_ts, 8);
+    }
+}
+
+/**
+ * @brief netif linkoutput wrapper that timestamps PTP event messages on egress.
+ *
+ * Runs after lwIP has built the complete frame (and computed the UDP checksum
+ * in software, if enabled), immediately before the frame is queued to the
+ * MAC. For every PTP event message, over UDP/IPv4, UDP/IPv6 or directly over Ethernet,
+ * the current time is recorded for net_get_tx_timestamp(). A one-step Sync
+ * additionally gets this time written into its originTimestamp, and an NTP
+ * response into its transmit timestamp, with a UDP checksum patched
+ * incrementally unless it is zero or computed by the MAC.
+ */
+static err_t ptp_linkoutput(struct netif *netif, struct pbuf *p)
+{
+    netif_linkoutput_fn mac_output = mac_linkoutput[net_netif_index(netif)];
+    uint8_t *frame = (uint8_t *)p->payload;
+    uint8_t *udp_hdr = NULL;
+    uint8_t *msg;
+    uint16_t eth_type;
+    int l3 = ETH_HDR_LEN;
+
+    if (p->len < ETH_HDR_LEN + PTP_TIMESTAMP_OFFSET + PTP_TIMESTAMP_LEN) {
+        return mac_output(netif, p);
+    }
+
+    eth_type = ((uint16_t)frame[12] << 8) | frame[13];
+    if (eth_type == ETH_TYPE_VLAN) {
+        l3 += 4;
+        eth_type = ((uint16_t)frame[16] << 8) | frame[17];
+    }
+
+    if (eth_type == PTP_ETHERTYPE) {
+        msg = frame + l3;
+        if ((msg[0] & 0x0F) >= 0x08) { // Event messages have messageType 0x0-0x7
+            return mac_output(netif, p);
+        }
+    } else if ((eth_type == ETH_TYPE_IPV4 && p->len >= l3 + 20 && frame[l3 + 9] == 17) ||
+               (eth_type == ETH_TYPE_IPV6 && p->len >= l3 + IPV6_HDR_LEN + UDP_HDR_LEN && frame[l3 + 6] == 17)) {
+        udp_hdr = frame + l3 + ((eth_type == ETH_TYPE_IPV4) ? (frame[l3] & 0x0F) * 4 : IPV6_HDR_LEN);
+        msg = udp_hdr + UDP_HDR_LEN;
+        if ((((uint16_t)udp_hdr[2] << 8) | udp_hdr[3]) != PTP_EVENT_PORT) {
+            if ((((uint16_t)udp_hdr[0] << 8) | udp_hdr[1]) == NTP_PORT && ptp_opts.ntp_server &&
+                (udp_hdr - frame) + UDP_HDR_LEN + NTP_PACKET_LEN <= p->len) {
+                net_stamp_ntp(netif, udp_hdr);
+            }
+            return mac_output(netif, p);
+        }
+    } else {
+        return mac_output(netif, p);
+    }
+
+    if ((msg - frame) + PTP_TIMESTAMP_OFFSET + PTP_TIMESTAMP_LEN > p->len) {
+        return mac_output(netif, p);
+    }
+
+    getTime(&last_tx_timestamp);
+    last_tx_timestamp_valid = TRUE;
+
+    if ((msg[0] & 0x0F) == SYNC_MSG && !(msg[6] & PTP_FLAG_TWO_STEP)) {
+        uint8_t old_ts[PTP_TIMESTAMP_LEN];
+        uint8_t *ts = msg + PTP_TIMESTAMP_OFFSET;
+        uint32_t nsec = (uint32_t)last_tx_timestamp.nanoseconds;
+        uint64_t sec = (uint64_t)last_tx_timestamp.seconds;
+
+        memcpy(old_ts, ts, PTP_TIMESTAMP_LEN);
+        ts[0] = (uint8_t)(sec >> 40); ts[1] = (uint8_t)(sec >> 32);
+        ts[2] = (uint8_t)(sec >> 24); ts[3] = (uint8_t)(sec >> 16);
+        ts[4] = (uint8_t)(sec >> 8);  ts[5] = (uint8_t)sec;
+        ts[6] = (uint8_t)(nsec >> 24); ts[7] = (uint8_t)(nsec >> 16);
+        ts[8] = (uint8_t)(nsec >> 8);  ts[9] = (uint8_t)nsec;
+
+        if (udp_hdr != NULL && !udp_csum_in_hw[net_netif_index(netif)] &&
+            (udp_hdr[UDP_CSUM_OFFSET] | udp_hdr[UDP_CSUM_OFFSET + 1]) != 0) {
+            udp_checksum_update(udp_hdr, UDP_HDR_LEN + PTP_TIMESTAMP_OFFSET, old_ts, PTP_TIMESTAMP_LEN);
+        }
+    }
+
+    return mac_output(netif, p);
+}
+
+/**
+ * @brief netif input wrapper that receives PTP over IEEE 802.3.
+ *
+ * Every frame is timestamped first, for net_get_rx_timestamp(). With PTP
+ * over Ethernet, frames with the PTP EtherType, tagged or untagged, are
+ * passed straight to handle_msg(); everything else continues to the
+ * driver's original input function (normally ethernet_input()).
+ */
+static err_t ptp_input(struct pbuf *p, struct netif *netif)
+{
+    int path = net_netif_index(netif);
+    const uint8_t *frame = (const uint8_t *)p->payload;
+    uint16_t eth_type;
+    int hdr_len = ETH_HDR_LEN;
+
+    getTime(&last_rx_timestamp);
+    last_rx_timestamp_valid = TRUE;
+
+    if (ptp_opts.transport != PTP_TRANSPORT_L2 || p->len < ETH_HDR_LEN + 4) {
+        return mac_input[path](p, netif);
+    }
+
+    eth_type = ((uint16_t)frame[12] << 8) | frame[13];
+    if (eth_type == ETH_TYPE_VLAN) {
+        hdr_len += 4;
+        eth_type = ((uint16_t)frame[16] << 8) | frame[17];
+    }
+    if (eth_type != PTP_ETHERTYPE) {
+        return mac_input[path](p, netif);
+    }
+
+    current_rx_path = (uint8_t)path;
+    current_rx_addr_valid = FALSE;
+    net_count_l2_filter_hit(frame);
+    handle_msg((uint8_t *)p->payload + hdr_len, p->len - hdr_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+/**
+ * @brief Get the time the frame being handled entered the stack.
+ *
+ * lwIP handles a received frame synchronously from the netif input hook,
+ * so from a receive callback this is the arrival time of that frame.
+ *
+ * @param time Updated with the ingress timestamp, if one is available.
+ * @return TRUE if a timestamp was returned, FALSE if the hook is not installed.
+ */
+bool net_get_rx_timestamp(TimeInternal *time)
+{
+    if (!last_rx_timestamp_valid) {
+        return FALSE;
+    }
+    *time = last_rx_timestamp;
+    return TRUE;
+}
+
+/**
+ * @brief Get the egress timestamp of the last PTP event message sent.
+ *
+ * lwIP transmits synchronously, so calling this right after net_send_event()
+ * returns the time that message was handed to the MAC.
+ *
+ * @param time Updated with the egress timestamp, if one is available.
+ * @return TRUE if a new timestamp was returned, FALSE otherwise.
+ */
+bool net_get_tx_timestamp(TimeInternal *time)
+{
+    if (!last_tx_timestamp_valid) {
+        return FALSE;
+    }
+    *time = last_tx_timestamp;
+    last_tx_timestamp_valid = FALSE;
+    return TRUE;
+}
+
+/**
+ * @brief Account a received PTP message against the filter entry that passed it.
+ *
+ * Must be called from an lwIP receive callback, where the destination
+ * address of the current packet is still available, after current_rx_path
+ * was set.
+ */
+static void net_count_filter_hit(void)
+{
+    ptp_mcast_filter_stats_t *stats = &mcast_filter_stats[current_rx_path];
+    const ip_addr_t *dst = ip_current_dest_addr();
+    int entry;
+
+    if (ip_addr_cmp(dst, &ptp_primary_multicast)) {
+        entry = MCAST_ENTRY_IPV4_PRIMARY;
+    } else if (ip_addr_cmp(dst, &ptp_peer_multicast)) {
+        entry = MCAST_ENTRY_IPV4_PEER;
+#if LWIP_IPV6
+    } else if (ip_addr_cmp(dst, &ptp_primary_multicast6)) {
+        entry = MCAST_ENTRY_IPV6_PRIMARY;
+    } else if (ip_addr_cmp(dst, &ptp_peer_multicast6)) {
+        entry = MCAST_ENTRY_IPV6_PEER;
+#endif
+    } else {
+        stats->unicast_hits++;
+        return;
+    }
+
+    stats->group_hits[entry]++;
+    if (!(stats->programmed_mask & (1 << entry))) {
+        stats->unexpected_hits++;
+    }
+}
+
+/**
+ * @brief Account a received PTP frame against the filter entry that passed it.
+ * @param dst The destination MAC address of the frame.
+ */
+static void net_count_l2_filter_hit(const uint8_t *dst)
+{
+    ptp_mcast_filter_stats_t *stats = &mcast_filter_stats[current_rx_path];
+    int entry;
+
+    for (entry = 0; entry < PTP_MCAST_FILTER_ENTRIES; ++entry) {
+        if (memcmp(dst, ptp_mcast_filter[entry].mac, 6) == 0) {
+            stats->group_hits[entry]++;
+            if (!(stats->programmed_mask & (1 << entry))) {
+                stats->unexpected_hits++;
+            }
+            return;
+        }
+    }
+    stats->unicast_hits++;
+}
+
+/**
+ * @brief Get a snapshot of the MAC multicast filter statistics of one path.
+ * @param path The path (interface).
+ * @param stats Destination for the statistics.
+ */
+void ptpd_net_get_filter_stats(uint8_t path, ptp_mcast_filter_stats_t *stats)
+{
+    if (path >= PTP_MAX_PATHS) {
+        path = 0;
+    }
+    *stats = mcast_filter_stats[path];
+}
+
+/**
+ * @brief Print the MAC multicast filter configuration and hit counters.
+ */
+void ptpd_net_print_filter_stats(void)
+{
+    int path, i;
+
+    for (path = 0; path < ptp_num_netifs; ++path) {
+        const ptp_mcast_filter_stats_t *stats = &mcast_filter_stats[path];
+
+        xil_printf("PTPd: Path %d MAC multicast filter %s\r\n", path, stats->hw_filter_active ? "active" : "INACTIVE");
+        for (i = 0; i < PTP_MCAST_FILTER_ENTRIES; ++i) {
+            if (stats->programmed_mask & (1 << i)) {
+                xil_printf("PTPd:   %s: %d hits\r\n", ptp_mcast_filter[i].name, stats->group_hits[i]);
+            }
+        }
+        xil_printf("PTPd:   unicast: %d, unexpected group: %d\r\n", stats->unicast_hits, stats->unexpected_hits);
+    }
+}
+
+/**
+ * @brief Return a transmit buffer to the pool once lwIP is done with it.
+ */
+static void tx_buffer_free(struct pbuf *p)
+{
+    ((ptp_tx_buffer_t *)p)->in_use = FALSE;
+}
+
+/**
+ * @brief Take a transmit buffer from a pool and copy a message into it.
+ * @param pool The pool to take it from.
+ * @param layer The lwIP layer the message starts at, to leave header room.
+ * @param data The message.
+ * @param len Its length.
+ * @param reserve Bytes left after the message for a trailing TLV.
+ * @return A pbuf over the buffer, or NULL if the message is too long or
+ *         every buffer is still queued for transmission.
+ */
+static struct pbuf *tx_buffer_alloc(ptp_tx_pool_t *pool, pbuf_layer layer, const void *data, int len, int reserve)
+{
+    struct pbuf *p;
+    int i;
+
+    if (len + reserve > PTP_TX_BUFFER_SIZE) {
+        xil_printf("PTPd: ERROR: %d byte message exceeds PTP_TX_BUFFER_SIZE\r\n", len + reserve);
+        return NULL;
+    }
+
+    for (i = 0; i < pool->count; ++i) {
+        ptp_tx_buffer_t *b = &pool->buffers[i];
+
+        if (b->in_use) {
+            continue;
+        }
+        b->in_use = TRUE;
+        b->pc.custom_free_function = tx_buffer_free;
+        p = pbuf_alloced_custom(layer, len + reserve, PBUF_RAM, &b->pc, b->data, sizeof(b->data));
+        if (p == NULL) {
+            b->in_use = FALSE;
+            return NULL;
+        }
+        memcpy(p->payload, data, len);
+        return p;
+    }
+
+    pool->exhausted++;
+    if (pool->report) {
+        xil_printf("PTPd: ERROR: All %d transmit buffers in use\r\n", pool->count);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Sends a PTP message directly over Ethernet.
+ *
+ * gPTP messages, and G.8275.1 messages when l2_peer_address is set, go to
+ * the peer group address 01-80-C2-00-00-0E, which bridges never forward;
+ * all others go to 01-1B-19-00-00-00. ethernet_output() adds the header
+ * (and the VLAN tag from ptpd_vlan_set_hook()) and hands the frame to
+ * ptp_linkoutput().
+ *
+ * @param data Pointer to the data to send.
+ * @param len Length of the data.
+ * @param path The path (interface) to send on.
+ * @return The number of bytes sent, or a negative value on error.
+ */
+static int net_send_frame(const void *data, int len, uint8_t path)
+{
+    bool peer = (ptp_opts.profile == PTP_PROFILE_GPTP || ptp_opts.l2_peer_address);
+    const struct eth_addr *dst = (const struct eth_addr *)ptp_mcast_filter[peer ? MCAST_ENTRY_L2_PEER : MCAST_ENTRY_L2_PRIMARY].mac;
+    struct netif *netif;
+    struct pbuf *p;
+    err_t err;
+
+    p = tx_buffer_alloc(&ptp_tx_pool, PBUF_LINK, data, len, auth_tlv_len());
+    if (p == NULL) {
+        return -1;
+    }
+    len = auth_sign(p->payload, len);
+
+    if (path >= ptp_num_netifs) {
+        path = 0;
+    }
+    netif = ptp_netifs[path];
+    err = ethernet_output(netif, p, (const struct eth_addr *)netif->hwaddr, dst, PTP_ETHERTYPE);
+    pbuf_free(p);
+
+    if (err != ERR_OK) {
+        xil_printf("PTPd: ERROR: Failed to send PTP frame (err: %d)\r\n", err);
+        return -1;
+    }
+
+    return len;
+}
+
 /**
  * @brief Sends a PTP network packet.
  *
- * This function allocates a pbuf, copies the provided data into it,
- * and sends it over the specified UDP PCB.
+ * This function copies the provided data into a transmit buffer and
+ * sends it over the specified UDP PCB.
  *
  * @param data Pointer to the data to send.
  * @param len Length of the data.
  * @param dst_addr Destination IP address.
  * @param pcb The UDP PCB to send the packet on.
+ * @param port Destination UDP port.
+ * @param path The path (interface) to send on.
  * @return The number of bytes sent, or a negative value on error.
  */
-static int net_send_packet(const void *data, int len, const ip_addr_t *dst_addr, struct udp_pcb *pcb, u16_t port)
+static int net_send_packet(const void *data, int len, const ip_addr_t *dst_addr, struct udp_pcb *pcb, u16_t port, uint8_t path)
 {
     err_t err;
     struct pbuf *p;
 
-    // Allocate a pbuf for the packet
-    p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+    if (ptp_opts.transport == PTP_TRANSPORT_L2) {
+        return net_send_frame(data, len, path);
+    }
+
+    // Copy the application data into a transmit buffer and sign it there,
+    // before the MAC takes the timestamp
+    p = tx_buffer_alloc(&ptp_tx_pool, PBUF_TRANSPORT, data, len, auth_tlv_len());
     if (p == NULL) {
-        xil_printf("PTPd: ERROR: Failed to allocate pbuf for sending\r\n");
         return -1;
     }
-
-    // Copy the application data into the pbuf
-    memcpy(p->payload, data, len);
+    len = auth_sign(p->payload, len);
 
     // Send the UDP packet
-    err = udp_sendto(pcb, p, dst_addr, port);
-    pbuf_free(p); // Free the pbuf
+    if (path >= ptp_num_netifs) {
+        path = 0;
+    }
+    err = udp_sendto_if(pcb, p, dst_addr, port, ptp_netifs[path]);
+    pbuf_free(p); // The buffer returns to the pool once the MAC has sent it
 
     if (err != ERR_OK) {
         xil_printf("PTPd: ERROR: Failed to send UDP packet (err: %d)\r\n");
@@ -142,6 +1031,41 @@ static int net_send_packet(const void *data, int len, const ip_addr_t *dst_addr,
     return len;
 }
 
+/**
+ * @brief Send a UDP datagram of another service from its own transmit buffers.
+ *
+ * A full pool is not reported here, the caller counts the failure; see
+ * net_udp_tx_exhausted().
+ *
+ * @param pcb The UDP PCB to send from.
+ * @param data Pointer to the data to send.
+ * @param len Length of the data.
+ * @param addr Destination address.
+ * @param port Destination port.
+ * @return The number of bytes sent, or a negative value on error.
+ */
+int net_send_udp(struct udp_pcb *pcb, const void *data, int len, const ip_addr_t *addr, u16_t port)
+{
+    struct pbuf *p;
+    err_t err;
+
+    p = tx_buffer_alloc(&udp_tx_pool, PBUF_TRANSPORT, data, len, 0);
+    if (p == NULL) {
+        return -1;
+    }
+    err = udp_sendto(pcb, p, addr, port);
+    pbuf_free(p);
+    return (err == ERR_OK) ? len : -1;
+}
+
+/**
+ * @brief Number of net_send_udp() calls that found every buffer taken.
+ */
+uint32_t net_udp_tx_exhausted(void)
+{
+    return udp_tx_pool.exhausted;
+}
+
 /**
  * @brief Send a PTP event message.
  * @param data Pointer to the data to send.
@@ -150,7 +1074,19 @@ static int net_send_packet(const void *data, int len, const ip_addr_t *dst_addr,
  */
 int net_send_event(const void *data, int len)
 {
-    return net_send_packet(data, len, &ptp_primary_multicast, ptp_event_pcb, PTP_EVENT_PORT);
+    return net_send_packet(data, len, &ptp_primary_multicast, ptp_event_pcb, PTP_EVENT_PORT, ptp_clock.active_path);
+}
+
+/**
+ * @brief Send a PTP event message on a specific path.
+ * @param data Pointer to the data to send.
+ * @param len Length of the data.
+ * @param path The path (interface) index to send on.
+ * @return Number of bytes sent or negative on error.
+ */
+int net_send_event_path(const void *data, int len, uint8_t path)
+{
+    return net_send_packet(data, len, &ptp_primary_multicast, ptp_event_pcb, PTP_EVENT_PORT, path);
 }
 
 /**
@@ -161,7 +1097,49 @@ int net_send_event(const void *data, int len)
  */
 int net_send_general(const void *data, int len)
 {
-    return net_send_packet(data, len, &ptp_primary_multicast, ptp_general_pcb, PTP_GENERAL_PORT);
+    return net_send_packet(data, len, &ptp_primary_multicast, ptp_general_pcb, PTP_GENERAL_PORT, ptp_clock.active_path);
+}
+
+/**
+ * @brief Send a PTP general message on a specific path.
+ * @param data Pointer to the data to send.
+ * @param len Length of the data.
+ * @param path The path (interface) index to send on.
+ * @return Number of bytes sent or negative on error.
+ */
+int net_send_general_path(const void *data, int len, uint8_t path)
+{
+    return net_send_packet(data, len, &ptp_primary_multicast, ptp_general_pcb, PTP_GENERAL_PORT, path);
+}
+
+/**
+ * @brief Send a PTP event message to a unicast address.
+ * @param data Pointer to the data to send.
+ * @param len Length of the data.
+ * @param addr The destination (IPv4 or IPv6) address.
+ * @return Number of bytes sent or negative on error.
+ */
+int net_send_event_to(const void *data, int len, const ip_addr_t *addr)
+{
+    if (addr == NULL) {
+        return -1;
+    }
+    return net_send_packet(data, len, addr, ptp_event_pcb, PTP_EVENT_PORT, ptp_clock.active_path);
+}
+
+/**
+ * @brief Send a PTP general message to a unicast address.
+ * @param data Pointer to the data to send.
+ * @param len Length of the data.
+ * @param addr The destination (IPv4 or IPv6) address.
+ * @return Number of bytes sent or negative on error.
+ */
+int net_send_general_to(const void *data, int len, const ip_addr_t *addr)
+{
+    if (addr == NULL) {
+        return -1;
+    }
+    return net_send_packet(data, len, addr, ptp_general_pcb, PTP_GENERAL_PORT, ptp_clock.active_path);
 }
 
 
@@ -171,6 +1149,12 @@ int net_send_general(const void *data, int len)
 static void ptp_event_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
 {
     if (p != NULL) {
+        int path = net_netif_index(ip_current_input_netif());
+
+        current_rx_path = (path < 0) ? 0 : (uint8_t)path;
+        ip_addr_copy(current_rx_addr, *addr);
+        current_rx_addr_valid = TRUE;
+        net_count_filter_hit();
         // Pass the received data to the main PTP message handler
         handle_msg(p->payload, p->len);
         pbuf_free(p);
@@ -183,6 +1167,12 @@ static void ptp_event_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf
 static void ptp_general_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
 {
     if (p != NULL) {
+        int path = net_netif_index(ip_current_input_netif());
+
+        current_rx_path = (path < 0) ? 0 : (uint8_t)path;
+        ip_addr_copy(current_rx_addr, *addr);
+        current_rx_addr_valid = TRUE;
+        net_count_filter_hit();
         // Pass the received data to the main PTP message handler
         handle_msg(p->payload, p->len);
         pbuf_free(p);
@@ -0,0 +1,256 @@
+/**
+ * @file ntp.c
+ * @brief NTPv4 server answering from the PTP-disciplined clock (RFC 5905).
+ *
+ * Clients are answered in server mode from a response packed once per
+ * second: leap indicator, stratum, precision, root delay and dispersion,
+ * reference ID and reference timestamp all derive from the PTP parent and
+ * change slowly. A request only costs a 48 byte copy and three patched
+ * timestamps, so the board keeps up with thousands of clients.
+ *
+ * The receive timestamp is the time the frame entered lwIP, taken by the
+ * netif input hook in net.c; the transmit timestamp is written by the
+ * linkoutput hook just before the frame is queued to the MAC. Both are the
+ * earliest and latest points a software timestamp can be taken on this
+ * stack, as for PTP.
+ */
+
+#include "../ptpd.h"
+
+extern ptp_clock_t ptp_clock;
+extern ptpd_opts ptp_opts;
+
+#if LWIP_IPV6
+#define NTP_BIND_ADDR       IP_ANY_TYPE
+#else
+#define NTP_BIND_ADDR       IP_ADDR_ANY
+#endif
+
+#define NTP_VERSION         4
+#define NTP_MODE_CLIENT     3
+#define NTP_MODE_SERVER     4
+#define NTP_LI_ALARM        3       // Leap indicator: clock not synchronized
+#define NTP_STRATUM_UNSYNC  16
+#define NTP_PRECISION       (-20)   // log2 s; ~1 us, the jitter of software timestamps
+#define NTP_UNIX_EPOCH      2208988800UL // 1970 - 1900 in seconds
+#define NTP_REFRESH_TICKS   PTP_TICK_RATE_HZ // Response template refreshed every second
+
+// Offsets in the NTP packet
+#define NTP_OFF_POLL        2
+#define NTP_OFF_ROOT_DELAY  4
+#define NTP_OFF_ROOT_DISP   8
+#define NTP_OFF_REFID       12
+#define NTP_OFF_REFERENCE   16
+#define NTP_OFF_ORIGIN      24
+#define NTP_OFF_RECEIVE     32
+
+static struct udp_pcb *ntp_pcb;
+PTP_ARENA static uint8_t ntp_template[NTP_PACKET_LEN]; // Prepacked server response
+const uint32_t ntp_arena_bytes = sizeof(ntp_template);
+static uint8_t ntp_leap_indicator;
+static int32_t refresh_timer;
+static uint32_t ntp_requests;
+static uint32_t ntp_responses;
+static uint32_t ntp_dropped;
+
+
+// --- Helper Functions ---
+
+static void put32(uint8_t *buf, uint32_t v)
+{
+    buf[0] = (uint8_t)(v >> 24);
+    buf[1] = (uint8_t)(v >> 16);
+    buf[2] = (uint8_t)(v >> 8);
+    buf[3] = (uint8_t)v;
+}
+
+/**
+ * @brief Convert nanoseconds to NTP short format (16.16 seconds).
+ */
+static uint32_t ns_to_short(int64_t ns)
+{
+    if (ns < 0) {
+        ns = -ns;
+    }
+    if (ns >= 65536LL * 1000000000LL) {
+        return 0xFFFFFFFF;
+    }
+    // 2^16 / 10^9 == 281475 / 2^32
+    return (uint32_t)((uint64_t)ns * 281475 >> 32);
+}
+
+/**
+ * @brief Pack the parts of the response that follow the PTP parent.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+static void refresh_template(ptp_clock_t *clock)
+{
+    const ptp_path_t *path = &clock->path[clock->active_path];
+    const uint8_t *gm = clock->parent_ds.grandmaster_identity;
+    bool synced = (clock->port_ds.port_state == PTP_SLAVE && !ptp_opts.syntonize_only); // Syntonized: no time of day
+    uint8_t *t = ntp_template;
+    int64_t dispersion;
+
+    if (!synced) {
+        ntp_leap_indicator = NTP_LI_ALARM;
+    } else if (clock->time_properties_ds.leap61) {
+        ntp_leap_indicator = 1;
+    } else if (clock->time_properties_ds.leap59) {
+        ntp_leap_indicator = 2;
+    } else {
+        ntp_leap_indicator = 0;
+    }
+
+    memset(t, 0, NTP_PACKET_LEN);
+    t[0] = (uint8_t)((ntp_leap_indicator << 6) | (NTP_VERSION << 3) | NTP_MODE_SERVER);
+    t[3] = (uint8_t)NTP_PRECISION;
+
+    if (!synced) {
+        // Unsynchronized: clients must not use us (RFC 5905 7.3)
+        t[1] = NTP_STRATUM_UNSYNC;
+        memcpy(t + NTP_OFF_REFID, "INIT", 4);
+        return;
+    }
+
+    // A grandmaster traceable to a primary reference makes us stratum 1,
+    // "PTP" being the reference. Otherwise stratum 2, with the grandmaster's
+    // identity folded into the reference ID as for an upstream server.
+    if (clock->time_properties_ds.time_traceable) {
+        t[1] = 1;
+        memcpy(t + NTP_OFF_REFID, "PTP\0", 4);
+    } else {
+        t[1] = 2;
+        t[NTP_OFF_REFID + 0] = gm[0] ^ gm[4];
+        t[NTP_OFF_REFID + 1] = gm[1] ^ gm[5];
+        t[NTP_OFF_REFID + 2] = gm[2] ^ gm[6];
+        t[NTP_OFF_REFID + 3] = gm[3] ^ gm[7];
+    }
+
+    // Round trip to the grandmaster, and our worst error against it
+    put32(t + NTP_OFF_ROOT_DELAY, ns_to_short(2 * (int64_t)path->mean_path_delay.nanoseconds));
+    dispersion = (int64_t)clock->offset_from_master.seconds * 1000000000LL + clock->offset_from_master.nanoseconds;
+    put32(t + NTP_OFF_ROOT_DISP, ns_to_short((dispersion < 0 ? -dispersion : dispersion) + path->offset_jitter));
+
+    // The clock was last corrected at the last Sync of the parent
+    ntp_pack_timestamp(t + NTP_OFF_REFERENCE, &path->sync_receive_time);
+}
+
+/**
+ * @brief UDP receive callback for NTP requests.
+ */
+static void ntp_recv_callback(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    uint8_t req[NTP_PACKET_LEN];
+    uint8_t resp[NTP_PACKET_LEN];
+    TimeInternal rx_ts, tx_ts;
+    uint8_t version;
+
+    if (!net_get_rx_timestamp(&rx_ts)) {
+        getTime(&rx_ts);
+    }
+    ntp_requests++;
+
+    if (p->tot_len < NTP_PACKET_LEN || pbuf_copy_partial(p, req, NTP_PACKET_LEN, 0) != NTP_PACKET_LEN) {
+        ntp_dropped++;
+        pbuf_free(p);
+        return;
+    }
+    pbuf_free(p);
+
+    version = (req[0] >> 3) & 0x07;
+    if ((req[0] & 0x07) != NTP_MODE_CLIENT || version < 1 || version > NTP_VERSION) {
+        ntp_dropped++;
+        return;
+    }
+
+    memcpy(resp, ntp_template, NTP_PACKET_LEN);
+    resp[0] = (uint8_t)((ntp_leap_indicator << 6) | (version << 3) | NTP_MODE_SERVER);
+    resp[NTP_OFF_POLL] = req[NTP_OFF_POLL];
+    memcpy(resp + NTP_OFF_ORIGIN, req + NTP_OFF_TRANSMIT, 8);
+    ntp_pack_timestamp(resp + NTP_OFF_RECEIVE, &rx_ts);
+    // Rewritten by the linkoutput hook as the frame goes to the MAC
+    getTime(&tx_ts);
+    ntp_pack_timestamp(resp + NTP_OFF_TRANSMIT, &tx_ts);
+
+    if (net_send_udp(pcb, resp, NTP_PACKET_LEN, addr, port) > 0) {
+        ntp_responses++;
+    } else {
+        ntp_dropped++;
+    }
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Start the NTP server on UDP port 123.
+ * @param clock A pointer to the PTP clock data structure.
+ * @return TRUE on success, FALSE otherwise.
+ */
+bool ntp_init(ptp_clock_t *clock)
+{
+    err_t err;
+
+    ntp_pcb = udp_new();
+    if (ntp_pcb == NULL) {
+        xil_printf("PTPd: ERROR: Failed to create NTP PCB\r\n");
+        return FALSE;
+    }
+    err = udp_bind(ntp_pcb, NTP_BIND_ADDR, NTP_PORT);
+    if (err != ERR_OK) {
+        xil_printf("PTPd: ERROR: Failed to bind NTP PCB (err: %d)\r\n", err);
+        udp_remove(ntp_pcb);
+        ntp_pcb = NULL;
+        return FALSE;
+    }
+
+    refresh_template(clock);
+    refresh_timer = NTP_REFRESH_TICKS;
+    udp_recv(ntp_pcb, ntp_recv_callback, clock);
+    xil_printf("PTPd: NTP server started\r\n");
+    return TRUE;
+}
+
+/**
+ * @brief Refresh the response template, called every protocol tick.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void ntp_tick(ptp_clock_t *clock)
+{
+    if (ntp_pcb == NULL || --refresh_timer > 0) {
+        return;
+    }
+    refresh_timer = NTP_REFRESH_TICKS;
+    refresh_template(clock);
+}
+
+/**
+ * @brief Pack a local time as an NTP timestamp (UTC, seconds since 1900).
+ *
+ * The PTP timescale is TAI; it is moved to UTC with the parent's
+ * currentUtcOffset.
+ *
+ * @param buf Receives the 8 byte timestamp.
+ * @param time The local time.
+ */
+PTP_LMB_TEXT void ntp_pack_timestamp(uint8_t *buf, const TimeInternal *time)
+{
+    uint32_t seconds = (uint32_t)time->seconds + NTP_UNIX_EPOCH;
+    uint32_t ns = (uint32_t)time->nanoseconds;
+
+    if (ptp_clock.time_properties_ds.ptp_timescale) {
+        seconds -= ptp_clock.time_properties_ds.current_utc_offset;
+    }
+    put32(buf, seconds);
+    // 2^32 / 10^9 == 4 + 1266874890 / 2^32, avoiding a 64 bit division
+    put32(buf + 4, ns * 4 + (uint32_t)((uint64_t)ns * 1266874890UL >> 32));
+}
+
+/**
+ * @brief Print the NTP server's request counters.
+ */
+void ntp_print_stats(void)
+{
+    xil_printf("PTPd: NTP: %d requests, %d answered, %d dropped (%d without a transmit buffer), stratum %d\r\n",
+        ntp_requests, ntp_responses, ntp_dropped, net_udp_tx_exhausted(), ntp_template[1]);
+}
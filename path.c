@@ -0,0 +1,410 @@
+/**
+ * @file path.c
+ * @brief Redundant network path tracking and failover.
+ *
+ * A slave with more than one network interface receives the parent's
+ * messages on every path. Each path keeps its own T1..T4 timestamps, mean
+ * path delay and offset statistics, but only the active path feeds the
+ * servo. When the active path fails or becomes clearly worse than another,
+ * the servo's input is switched over without resetting it.
+ *
+ * The active path's mean path delay also paces the E2E Delay_Req rate: a
+ * delay that stays put lets the interval grow, a jump, a failover, a link
+ * event or a new parent take it straight back to the fastest rate.
+ */
+
+#include "../ptpd.h"
+#include <stdlib.h> // For abs()
+
+extern ptpd_opts ptp_opts;
+
+#define JITTER_SHIFT        3 // Offset jitter smoothing: weight 1/8 per sample
+#define PATH_MIN_SYNCS      8 // Samples before a path's jitter is trusted
+#define PATH_BETTER_FACTOR  2 // A standby path must be this much quieter to take over
+#define DELAY_REQ_STABLE    16 // Delay_Resps within delay_req_stable_ns before the interval doubles
+#define DELAY_REQ_LOG_MAX   5 // Largest logMinDelayReqInterval of the default profiles (J.3.2, J.4.2)
+
+// --- Helper Functions ---
+
+/**
+ * @brief Convert a PTP log interval to nanoseconds.
+ */
+static int64_t log_interval_to_ns(int8_t log_interval)
+{
+    if (log_interval >= 0) {
+        return 1000000000LL << log_interval;
+    }
+    return 1000000000LL >> -log_interval;
+}
+
+/**
+ * @brief Check whether a path has missed its Sync messages.
+ *
+ * A path is stale once 1.5 Sync intervals have passed since its last Sync,
+ * i.e. at the latest half an interval after the first missing message.
+ */
+static bool path_is_stale(const ptp_path_t *path, const TimeInternal *now)
+{
+    int64_t since_sync = (now->seconds - path->sync_receive_time.seconds) * 1000000000LL +
+                         (now->nanoseconds - path->sync_receive_time.nanoseconds);
+    int64_t interval = log_interval_to_ns(path->log_sync_interval);
+
+    return since_sync > interval + interval / 2;
+}
+
+/**
+ * @brief Check whether a path can drive the servo.
+ */
+static bool path_is_usable(const ptp_path_t *path, const TimeInternal *now)
+{
+    return path->link_up && path->sync_seen && path->delay_valid && !path_is_stale(path, now);
+}
+
+/**
+ * @brief Count the Sync intervals since the servo's previous sample.
+ *
+ * More than one means Syncs, or their Follow_Ups, were lost in between.
+ * Counted across paths, so a failover alone is not a gap.
+ */
+static uint16_t servo_sample_intervals(ptp_clock_t *clock, const ptp_path_t *path)
+{
+    uint16_t intervals = path->sync_sequence_id - clock->servo_sequence_id;
+    bool valid = clock->servo_sequence_valid;
+
+    clock->servo_sequence_id = path->sync_sequence_id;
+    clock->servo_sequence_valid = TRUE;
+
+    if (!valid || intervals == 0 || intervals >= SEQ_WINDOW) {
+        return 1;
+    }
+    return intervals;
+}
+
+/**
+ * @brief Make another path the servo's input.
+ *
+ * The servo and its filters are left untouched; only the path delay the
+ * servo subtracts is replaced by the new path's own measurement.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ * @param to The new active path.
+ * @param reason Short description for the log.
+ */
+static void path_switch(ptp_clock_t *clock, uint8_t to, const char *reason)
+{
+    if (to == clock->active_path) {
+        return;
+    }
+
+    xil_printf("PTPd: Path failover %d -> %d (%s)\r\n", clock->active_path, to, reason);
+
+    clock->path[clock->active_path].failovers++;
+    clock->active_path = to;
+    clock->mean_path_delay = clock->path[to].mean_path_delay;
+    path_delay_req_reset(clock, "path failover");
+}
+
+/**
+ * @brief Lengthen the Delay_Req interval while the path delay is stable.
+ *
+ * The delay is compared against the value it had when the interval was
+ * last reset, not against the previous response, so a slow drift adds up
+ * and is caught like a jump.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ * @param path The active path, its mean path delay just updated.
+ */
+static void adapt_delay_req(ptp_clock_t *clock, const ptp_path_t *path)
+{
+    const PortIdentity *parent = &clock->parent_ds.parent_port_identity;
+    int32_t delay = path->mean_path_delay.nanoseconds;
+    int8_t max_interval;
+
+    if (memcmp(&clock->delay_req_parent, parent, sizeof(PortIdentity)) != 0) {
+        path_delay_req_reset(clock, "new parent");
+        clock->delay_req_parent = *parent;
+    }
+
+    if (!clock->delay_req_reference_valid) {
+        clock->delay_req_reference = delay;
+        clock->delay_req_reference_valid = TRUE;
+        return;
+    }
+
+    if (abs(delay - clock->delay_req_reference) > ptp_opts.delay_req_change_ns) {
+        path_delay_req_reset(clock, "path delay changed");
+        clock->delay_req_reference = delay;
+        clock->delay_req_reference_valid = TRUE;
+        return;
+    }
+    if (abs(delay - clock->delay_req_reference) > ptp_opts.delay_req_stable_ns) {
+        clock->delay_req_stable = 0;
+        return;
+    }
+
+    max_interval = (ptp_opts.delay_req_interval_max > DELAY_REQ_LOG_MAX) ? DELAY_REQ_LOG_MAX : ptp_opts.delay_req_interval_max;
+    if (++clock->delay_req_stable >= DELAY_REQ_STABLE && clock->delay_req_log_interval < max_interval) {
+        clock->delay_req_log_interval++;
+        clock->delay_req_stable = 0;
+        xil_printf("PTPd: Path delay stable, Delay_Req interval now 2^%d s\r\n", clock->delay_req_log_interval);
+    }
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Reset the path table.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param num_paths Number of network interfaces PTP runs on.
+ */
+void path_init(ptp_clock_t *clock, uint8_t num_paths)
+{
+    uint8_t i;
+
+    memset(clock->path, 0, sizeof(clock->path));
+    clock->num_paths = (num_paths > PTP_MAX_PATHS) ? PTP_MAX_PATHS : num_paths;
+    clock->active_path = 0;
+
+    for (i = 0; i < clock->num_paths; ++i) {
+        clock->path[i].owd_filt.s = 4; // Same filter strength as the servo
+        clock->path[i].log_sync_interval = clock->port_ds.log_sync_interval;
+        clock->path[i].link_up = net_path_link_up(i);
+        clock->path[i].delay_asymmetry = ptp_opts.delay_asymmetry_ns[i];
+        clock->path[i].ingress_latency = ptp_opts.ingress_latency_ns[i];
+        clock->path[i].egress_latency = ptp_opts.egress_latency_ns[i];
+    }
+    clock->delay_req_link_up = clock->path[0].link_up;
+    path_delay_req_reset(clock, NULL);
+}
+
+/**
+ * @brief Record the arrival of a Sync from the parent on one path.
+ *
+ * Call after the path's sync_receive_time (T2) has been captured. If another
+ * path delivers a Sync the active path has not, the active path has lost at
+ * least one message and the servo is moved immediately.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ * @param rx The path the Sync was received on.
+ * @param header The header of the Sync message.
+ */
+void path_sync_received(ptp_clock_t *clock, uint8_t rx, const PtpHeader *header)
+{
+    ptp_path_t *path = &clock->path[rx];
+    ptp_path_t *active = &clock->path[clock->active_path];
+
+    if (path->sync_seen) {
+        uint16_t gap = header->sequenceId - path->sync_sequence_id;
+        if (gap > 1 && gap < 0x8000) {
+            path->sync_missed += gap - 1;
+        }
+    }
+
+    path->sync_seen = TRUE;
+    path->sync_sequence_id = header->sequenceId;
+    path->log_sync_interval = header->logMessageInterval;
+    path->sync_count++;
+
+    if (rx != clock->active_path && path->delay_valid) {
+        uint16_t lead = header->sequenceId - active->sync_sequence_id;
+        if (!active->sync_seen || (lead >= 2 && lead < 0x8000)) {
+            path_switch(clock, rx, "Sync lost on active path");
+        }
+    }
+}
+
+/**
+ * @brief Process a complete Sync (T1 known) received on one path.
+ *
+ * Updates the path's offset statistics and, for the active path, runs the
+ * servo with the path's own mean path delay (or with the ensemble estimate,
+ * when ensemble mode is on).
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ * @param rx The path the Sync was received on.
+ * @param precise_origin_timestamp T1 from the Sync or Follow_Up.
+ */
+void path_offset_ready(ptp_clock_t *clock, uint8_t rx, const TimeInternal *precise_origin_timestamp)
+{
+    ptp_path_t *path = &clock->path[rx];
+    TimeInternal previous = path->offset_from_master;
+
+    servo_update_path_offset(path, precise_origin_timestamp);
+
+    if (path->delay_valid && path->sync_count > 1 &&
+        previous.seconds == 0 && path->offset_from_master.seconds == 0) {
+        int32_t change = abs(path->offset_from_master.nanoseconds - previous.nanoseconds);
+        path->offset_jitter += (change - path->offset_jitter) >> JITTER_SHIFT;
+    }
+
+    if (rx == clock->active_path) {
+        TimeInternal estimate;
+
+        switch (step_check(clock, precise_origin_timestamp, &path->sync_receive_time, path->sync_sequence_id,
+                           log_interval_to_ns(path->log_sync_interval))) {
+        case GM_STEP_SKIP:
+            return; // A step of the parent is not followed yet
+        case GM_STEP_JUMP:
+            if (ptp_opts.syntonize_only) {
+                clock->synt_valid = FALSE; // Only the rate is followed; measure it afresh
+                return;
+            }
+            servo_step_clock(clock, &path->offset_from_master);
+            return;
+        default:
+            break;
+        }
+
+        clock->mean_path_delay = path->mean_path_delay;
+        clock->delay_ms = path->delay_ms;
+        clock->servo_intervals = servo_sample_intervals(clock, path);
+
+        if (ptp_opts.syntonize_only) {
+            servo_syntonize(clock, precise_origin_timestamp, &path->delay_ms, log_interval_to_ns(path->log_sync_interval));
+            return;
+        }
+
+        // In ensemble mode the servo follows the combined estimate instead.
+        // Either way the offset already carries the path's latency and
+        // asymmetry corrections.
+        if (ensemble_estimate(clock, &path->offset_from_master, &estimate)) {
+            servo_set_offset(clock, &estimate);
+        } else {
+            servo_set_offset(clock, &path->offset_from_master);
+        }
+        servo_update_clock(clock);
+    }
+}
+
+/**
+ * @brief Process a Delay_Resp received on one path.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param rx The path the Delay_Req/Delay_Resp exchange used.
+ * @param recv_timestamp T4 from the Delay_Resp.
+ */
+void path_delay_ready(ptp_clock_t *clock, uint8_t rx, const TimeInternal *recv_timestamp)
+{
+    ptp_path_t *path = &clock->path[rx];
+
+    servo_update_path_delay(path, recv_timestamp);
+
+    if (rx == clock->active_path) {
+        clock->mean_path_delay = path->mean_path_delay;
+        if (ptp_opts.delay_req_adaptive) {
+            adapt_delay_req(clock, path);
+        }
+    }
+}
+
+/**
+ * @brief Current E2E Delay_Req interval.
+ *
+ * Never shorter than the logMinDelayReqInterval the parent set.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ * @return log2 of the interval in seconds.
+ */
+int8_t path_delay_req_interval(ptp_clock_t *clock)
+{
+    if (!ptp_opts.delay_req_adaptive || clock->delay_req_log_interval < clock->port_ds.log_min_delay_req_interval) {
+        return clock->port_ds.log_min_delay_req_interval;
+    }
+    return clock->delay_req_log_interval;
+}
+
+/**
+ * @brief Return to the fastest Delay_Req rate after a change of the path.
+ *
+ * A Delay_Req already waiting on a long interval is sent on the next tick.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ * @param reason Short description for the log, or NULL when the port
+ *               (re)starts measuring.
+ */
+void path_delay_req_reset(ptp_clock_t *clock, const char *reason)
+{
+    if (reason != NULL && clock->delay_req_log_interval > clock->port_ds.log_min_delay_req_interval) {
+        xil_printf("PTPd: Delay_Req interval back to 2^%d s (%s)\r\n", clock->port_ds.log_min_delay_req_interval, reason);
+    }
+    clock->delay_req_log_interval = clock->port_ds.log_min_delay_req_interval;
+    clock->delay_req_stable = 0;
+    clock->delay_req_reference_valid = FALSE;
+
+    if (clock->delay_req_interval_timer > 1) {
+        clock->delay_req_interval_timer = 1;
+    }
+}
+
+/**
+ * @brief Periodic path supervision, called from the protocol tick.
+ *
+ * Moves the servo off the active path if its link is down or its Syncs have
+ * stopped, or onto a standby path whose offset jitter is much lower.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void path_tick(ptp_clock_t *clock)
+{
+    ptp_path_t *active = &clock->path[clock->active_path];
+    TimeInternal now;
+    int best = -1;
+    uint8_t i;
+
+    for (i = 0; i < clock->num_paths; ++i) {
+        clock->path[i].link_up = net_path_link_up(i);
+    }
+    // The delay may have changed across a link bounce
+    if (active->link_up != clock->delay_req_link_up) {
+        clock->delay_req_link_up = active->link_up;
+        if (ptp_opts.delay_req_adaptive) {
+            path_delay_req_reset(clock, "link event");
+        }
+    }
+
+    if (clock->num_paths < 2) {
+        return;
+    }
+
+    getTime(&now);
+
+    // Find the quietest usable standby path
+    for (i = 0; i < clock->num_paths; ++i) {
+        if (i == clock->active_path || !path_is_usable(&clock->path[i], &now)) {
+            continue;
+        }
+        if (best < 0 || clock->path[i].offset_jitter < clock->path[best].offset_jitter) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        return;
+    }
+
+    if (!active->link_up) {
+        path_switch(clock, best, "link down");
+    } else if (!active->sync_seen || path_is_stale(active, &now)) {
+        active->sync_missed++;
+        path_switch(clock, best, "Sync timeout");
+    } else if (active->sync_count >= PATH_MIN_SYNCS && clock->path[best].sync_count >= PATH_MIN_SYNCS &&
+               clock->path[best].offset_jitter * PATH_BETTER_FACTOR < active->offset_jitter) {
+        path_switch(clock, best, "lower jitter");
+    }
+}
+
+/**
+ * @brief Print per-path offset and delay statistics.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void path_print_stats(ptp_clock_t *clock)
+{
+    uint8_t i;
+
+    for (i = 0; i < clock->num_paths; ++i) {
+        ptp_path_t *path = &clock->path[i];
+        xil_printf("PTPd: Path %d%s: link %s, offset %d ns, delay %d ns, jitter %d ns, syncs %d, missed %d, failovers %d\r\n",
+            i, (i == clock->active_path) ? " (active)" : "", path->link_up ? "up" : "down",
+            path->offset_from_master.nanoseconds, path->mean_path_delay.nanoseconds, path->offset_jitter,
+            path->sync_count, path->sync_missed, path->failovers);
+    }
+}
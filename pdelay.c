@@ -0,0 +1,314 @@
+/**
+ * @file pdelay.c
+ * @brief Peer-to-peer delay mechanism and asCapable for the gPTP profile.
+ *
+ * Every path measures the link delay to its neighbor with Pdelay_Req,
+ * Pdelay_Resp and Pdelay_Resp_Follow_Up, whatever the port state, and
+ * answers the neighbor's Pdelay_Req the same way. Successive exchanges also
+ * give the neighborRateRatio, which scales the link delay and is added to
+ * the grandmaster rate ratio carried in Follow_Up. A path is asCapable while
+ * its neighbor keeps answering and the link delay stays below
+ * neighborPropDelayThresh (IEEE 802.1AS-2011 11.2.2).
+ */
+
+#include "../ptpd.h"
+
+extern ptp_clock_t ptp_clock;
+extern ptpd_opts ptp_opts;
+
+#define RATE_OFFSET_SHIFT   41   // Rate offsets are (ratio - 1) * 2^41, as in the Follow_Up TLV
+#define RATE_RATIO_MAX_PPM  1000 // Larger neighbor rate differences are measurement errors
+
+// --- Helper Functions ---
+
+static int64_t time_to_ns(const TimeInternal *t)
+{
+    return t->seconds * 1000000000LL + t->nanoseconds;
+}
+
+/**
+ * @brief Move a timestamp by a latency correction, keeping it normalised.
+ */
+static void add_latency(TimeInternal *t, int32_t ns)
+{
+    t->nanoseconds += ns;
+    while (t->nanoseconds < 0) {
+        t->nanoseconds += 1000000000;
+        t->seconds--;
+    }
+    while (t->nanoseconds >= 1000000000) {
+        t->nanoseconds -= 1000000000;
+        t->seconds++;
+    }
+}
+
+static bool is_own_clock(const PortIdentity *port)
+{
+    return memcmp(port->clockIdentity, ptp_clock.port_ds.port_identity.clockIdentity, 8) == 0;
+}
+
+static bool is_same_port(const PortIdentity *a, const PortIdentity *b)
+{
+    return memcmp(a->clockIdentity, b->clockIdentity, 8) == 0 && a->portNumber == b->portNumber;
+}
+
+/**
+ * @brief Change a path's asCapable, logging the reason on a change.
+ */
+static void set_as_capable(ptp_path_t *path, uint8_t rx, bool as_capable, const char *reason)
+{
+    if (path->pdelay.as_capable != as_capable) {
+        xil_printf("PTPd: Path %d asCapable %s (%s)\r\n", rx, as_capable ? "TRUE" : "FALSE", reason);
+    }
+    path->pdelay.as_capable = as_capable;
+}
+
+/**
+ * @brief Update the neighborRateRatio from two successive exchanges.
+ *
+ * neighborRateRatio = (t3 - prev_t3) / (t4 - prev_t4), kept as an offset
+ * from 1 in units of 2^-41. The interval is pre-scaled so the division
+ * cannot overflow for any Pdelay_Req interval.
+ */
+static void update_rate_ratio(ptp_peer_delay_t *pd, const TimeInternal *t3, const TimeInternal *t4)
+{
+    if (pd->exchanges > 0) {
+        int64_t dt3 = time_to_ns(t3) - time_to_ns(&pd->prev_t3);
+        int64_t dt4 = time_to_ns(t4) - time_to_ns(&pd->prev_t4);
+        int64_t diff = dt3 - dt4;
+
+        if (dt4 > 0 && (dt4 >> 11) > 0 && diff < dt4 / (1000000 / RATE_RATIO_MAX_PPM) &&
+            -diff < dt4 / (1000000 / RATE_RATIO_MAX_PPM)) {
+            pd->neighbor_rate_offset = (int32_t)((diff << (RATE_OFFSET_SHIFT - 11)) / (dt4 >> 11));
+            pd->rate_ratio_valid = TRUE;
+        }
+    }
+    pd->prev_t3 = *t3;
+    pd->prev_t4 = *t4;
+}
+
+/**
+ * @brief Finish one exchange: rate ratio, link delay and asCapable.
+ *
+ * meanLinkDelay = ((t4 - t1) * neighborRateRatio - (t3 - t2) - correction) / 2
+ * (IEEE 802.1AS-2011 11.2.15.2.4), with t1 and t4 moved to the reference
+ * plane by the path's egress and ingress latencies.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ * @param rx The path of the exchange.
+ * @param t3 The time the neighbor sent its Pdelay_Resp.
+ */
+static void pdelay_complete(ptp_clock_t *clock, uint8_t rx, const TimeInternal *t3)
+{
+    ptp_path_t *path = &clock->path[rx];
+    ptp_peer_delay_t *pd = &path->pdelay;
+    int64_t residence;
+    int64_t turnaround;
+    int64_t delay;
+    TimeInternal t4 = pd->t4;
+
+    add_latency(&t4, -path->ingress_latency);
+
+    update_rate_ratio(pd, t3, &t4);
+
+    residence = time_to_ns(&t4) - (time_to_ns(&pd->t1) + path->egress_latency);
+    residence += (residence * pd->neighbor_rate_offset) >> RATE_OFFSET_SHIFT;
+    turnaround = time_to_ns(t3) - time_to_ns(&pd->t2);
+    delay = (residence - turnaround - (pd->correction >> 16)) / 2;
+
+    pd->exchanges++;
+    pd->lost_responses = 0;
+    pd->mean_link_delay = (int32_t)delay;
+
+    if (delay < 0 || delay > ptp_opts.neighbor_prop_delay_thresh_ns) {
+        set_as_capable(path, rx, FALSE, "link delay out of range");
+        return;
+    }
+    if (!pd->rate_ratio_valid) {
+        return; // Wait for the second exchange before trusting the link
+    }
+
+    servo_update_path_peer_delay(path, pd->mean_link_delay);
+    set_as_capable(path, rx, TRUE, "neighbor delay measured");
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Reset the peer delay state of all paths and start measuring.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void pdelay_init(ptp_clock_t *clock)
+{
+    uint8_t i;
+
+    for (i = 0; i < PTP_MAX_PATHS; ++i) {
+        memset(&clock->path[i].pdelay, 0, sizeof(ptp_peer_delay_t));
+    }
+
+    if (clock->port_ds.delay_mechanism == PTP_DELAY_MECHANISM_P2P) {
+        timer_start(&clock->pdelay_req_interval_timer, GPTP_PDELAY_REQ_INTERVAL_MS);
+    }
+}
+
+/**
+ * @brief Send a Pdelay_Req on every path, called when the interval timer expires.
+ *
+ * A request still unanswered when the next one is due counts as lost; more
+ * than allowedLostResponses in a row make the path not asCapable.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void pdelay_issue_req(ptp_clock_t *clock)
+{
+    uint8_t buf[54];
+    uint8_t i;
+
+    for (i = 0; i < clock->num_paths; ++i) {
+        ptp_path_t *path = &clock->path[i];
+        ptp_peer_delay_t *pd = &path->pdelay;
+
+        if (!path->link_up) {
+            set_as_capable(path, i, FALSE, "link down");
+            continue;
+        }
+
+        if (pd->waiting_for_resp || pd->waiting_for_follow_up) {
+            if (++pd->lost_responses > GPTP_ALLOWED_LOST_RESPONSES) {
+                set_as_capable(path, i, FALSE, "Pdelay_Resp lost");
+                pd->rate_ratio_valid = FALSE;
+                pd->exchanges = 0;
+            }
+        }
+
+        pd->sequence_id = clock->sent_pdelay_req_sequence_id;
+        getTime(&pd->t1);
+        msg_pack_pdelay_req(buf, clock, &pd->t1);
+        net_send_event_path(buf, 54, i);
+        net_get_tx_timestamp(&pd->t1); // Refine t1 to the time the frame reached the MAC
+        pd->waiting_for_resp = TRUE;
+        pd->waiting_for_follow_up = FALSE;
+    }
+
+    clock->sent_pdelay_req_sequence_id++;
+    timer_start(&clock->pdelay_req_interval_timer, GPTP_PDELAY_REQ_INTERVAL_MS);
+}
+
+/**
+ * @brief Answer a neighbor's Pdelay_Req (two-step responder).
+ *
+ * The responder runs in every port state, so a neighbor can determine
+ * asCapable before any BMC decision is made.
+ *
+ * @param header The header of the Pdelay_Req.
+ * @param rx_ts The time the request arrived (t2).
+ */
+void pdelay_handle_req(const PtpHeader *header, const TimeInternal *rx_ts)
+{
+    uint8_t rx = net_rx_path();
+    uint8_t buf[54];
+    TimeInternal t2 = *rx_ts;
+    TimeInternal t3;
+
+    if (ptp_clock.port_ds.delay_mechanism != PTP_DELAY_MECHANISM_P2P ||
+        ptp_clock.port_ds.port_state == PTP_INITIALIZING || is_own_clock(&header->sourcePortIdentity)) {
+        return;
+    }
+
+    add_latency(&t2, -ptp_clock.path[rx].ingress_latency);
+    msg_pack_pdelay_resp(buf, &ptp_clock, header, &t2);
+
+    getTime(&t3);
+    net_send_event_path(buf, 54, rx);
+    net_get_tx_timestamp(&t3);
+    add_latency(&t3, ptp_clock.path[rx].egress_latency);
+
+    msg_pack_pdelay_resp_follow_up(buf, &ptp_clock, header, &t3);
+    net_send_general_path(buf, 54, rx);
+}
+
+/**
+ * @brief Handle the neighbor's Pdelay_Resp to our outstanding Pdelay_Req.
+ * @param header The header of the Pdelay_Resp.
+ * @param requestReceiptTimestamp The time the neighbor received our request (t2).
+ * @param requestingPortIdentity The port the response is meant for.
+ * @param rx_ts The time the response arrived (t4).
+ */
+void pdelay_handle_resp(const PtpHeader *header, const TimeInternal *requestReceiptTimestamp,
+                        const PortIdentity *requestingPortIdentity, const TimeInternal *rx_ts)
+{
+    uint8_t rx = net_rx_path();
+    ptp_path_t *path = &ptp_clock.path[rx];
+    ptp_peer_delay_t *pd = &path->pdelay;
+    TimeInternal t4 = *rx_ts;
+
+    if (!is_same_port(requestingPortIdentity, &ptp_clock.port_ds.port_identity) ||
+        header->sequenceId != pd->sequence_id) {
+        return;
+    }
+
+    if (is_own_clock(&header->sourcePortIdentity)) {
+        set_as_capable(path, rx, FALSE, "own Pdelay_Req reflected");
+        return;
+    }
+
+    if (!pd->waiting_for_resp) {
+        // A second answer to the same request: more than one neighbor on the link
+        if (pd->waiting_for_follow_up && !is_same_port(&header->sourcePortIdentity, &pd->responder)) {
+            pd->waiting_for_follow_up = FALSE;
+            set_as_capable(path, rx, FALSE, "multiple Pdelay responders");
+        }
+        return;
+    }
+
+    pd->waiting_for_resp = FALSE;
+    pd->responder = header->sourcePortIdentity;
+    pd->t2 = *requestReceiptTimestamp;
+    pd->t4 = t4;
+    pd->correction = header->correctionField;
+
+    if (header->flags & 0x0200) { // 2-step responder
+        pd->waiting_for_follow_up = TRUE;
+    } else { // 1-step: the turnaround time is in the correctionField
+        pdelay_complete(&ptp_clock, rx, requestReceiptTimestamp);
+    }
+}
+
+/**
+ * @brief Handle the Pdelay_Resp_Follow_Up completing the current exchange.
+ * @param header The header of the Pdelay_Resp_Follow_Up.
+ * @param responseOriginTimestamp The time the neighbor sent its Pdelay_Resp (t3).
+ * @param requestingPortIdentity The port the response is meant for.
+ */
+void pdelay_handle_resp_follow_up(const PtpHeader *header, const TimeInternal *responseOriginTimestamp, const PortIdentity *requestingPortIdentity)
+{
+    uint8_t rx = net_rx_path();
+    ptp_peer_delay_t *pd = &ptp_clock.path[rx].pdelay;
+
+    if (!pd->waiting_for_follow_up || header->sequenceId != pd->sequence_id ||
+        !is_same_port(requestingPortIdentity, &ptp_clock.port_ds.port_identity) ||
+        !is_same_port(&header->sourcePortIdentity, &pd->responder)) {
+        return;
+    }
+
+    pd->waiting_for_follow_up = FALSE;
+    pd->correction += header->correctionField;
+    pdelay_complete(&ptp_clock, rx, responseOriginTimestamp);
+}
+
+/**
+ * @brief Print the peer delay state of every path.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void pdelay_print_stats(ptp_clock_t *clock)
+{
+    uint8_t i;
+
+    for (i = 0; i < clock->num_paths; ++i) {
+        ptp_peer_delay_t *pd = &clock->path[i].pdelay;
+        xil_printf("PTPd: Path %d: asCapable %s, link delay %d ns, neighbor rate %d (2^-41), exchanges %d, lost %d\r\n",
+            i, pd->as_capable ? "TRUE" : "FALSE", pd->mean_link_delay, pd->neighbor_rate_offset,
+            pd->exchanges, pd->lost_responses);
+    }
+}
@@ -4,7 +4,6 @@
 // These are defined and initialized in main.c and are used by the PTP engine.
 extern ptp_clock_t ptp_clock;
 extern ptpd_opts ptp_opts;
-extern foreign_master_record_t foreign_records[];
 
 /**
  * @brief Main entry point for PTP daemon initialization.
@@ -14,16 +13,19 @@ extern foreign_master_record_t foreign_records[];
  *
  * @param clock A pointer to the ptp_clock_t structure.
  * @param opts A pointer to the ptpd_opts runtime options.
- * @param records A pointer to the foreign master record array.
  * @return 0 on success, a non-zero value on failure.
  */
-int ptp_startup(ptp_clock_t *clock, ptpd_opts *opts, foreign_master_record_t *records)
+int ptp_startup(ptp_clock_t *clock, ptpd_opts *opts)
 {
     xil_printf("PTPd: Starting PTP daemon\r\n");
+    ptpd_print_memory_report();
+
+    if (!auth_init()) {
+        return -1;
+    }
 
     // Initialize the main PTP clock data structure
     memset(clock, 0, sizeof(ptp_clock_t));
-    clock->foreign = records;
 
     // Initialize protocol state machines
     init_data(clock, opts);
@@ -35,6 +37,53 @@ int ptp_startup(ptp_clock_t *clock, ptpd_opts *opts, foreign_master_record_t *re
     return 0;
 }
 
+// Section sizes of the linked image, set by ptp_footprint.ld. Weak, so an
+// application that does not include the fragment still links (all zero).
+extern char __ptp_image_text_size[] __attribute__((weak));
+extern char __ptp_image_rodata_size[] __attribute__((weak));
+extern char __ptp_image_data_size[] __attribute__((weak));
+extern char __ptp_image_bss_size[] __attribute__((weak));
+
+/**
+ * @brief Print the static memory the PTP daemon owns.
+ *
+ * All of it is sized in ptpd_config.h and allocated at build time; the
+ * same figures appear per module under .bss.ptp_arena in the linker map.
+ * The image's section sizes come from the linker (ptp_footprint.ld), so
+ * builds with and without PTP_SLAVE_ONLY can be compared on the target.
+ */
+void ptpd_print_memory_report(void)
+{
+    uint32_t total = sizeof(ptp_clock_t) + sizeof(ptpd_opts) + net_arena_bytes +
+                     unicast_arena_bytes + ensemble_arena_bytes + monitor_arena_bytes + admit_arena_bytes +
+                     event_arena_bytes + accept_arena_bytes + auth_arena_bytes + mgmt_arena_bytes + ntp_arena_bytes;
+
+    xil_printf("PTPd: Memory: clock %d bytes (servo group %d), path %d, foreign record %d\r\n",
+        (int)sizeof(ptp_clock_t), (int)offsetof(ptp_clock_t, port_ds), (int)sizeof(ptp_path_t),
+        (int)sizeof(foreign_master_record_t));
+    xil_printf("PTPd: Memory: options %d, TX buffers %d (%d + %d x %d), unicast %d, ensemble %d, monitor %d, Delay_Req sources %d, events %d, acceptable masters %d, auth keys %d, management %d, NTP %d\r\n",
+        (int)sizeof(ptpd_opts), (int)net_arena_bytes, PTP_TX_BUFFERS, PTP_UDP_TX_BUFFERS, PTP_TX_BUFFER_SIZE,
+        (int)unicast_arena_bytes, (int)ensemble_arena_bytes, (int)monitor_arena_bytes, (int)admit_arena_bytes,
+        (int)event_arena_bytes, (int)accept_arena_bytes, (int)auth_arena_bytes,
+        (int)mgmt_arena_bytes, (int)ntp_arena_bytes);
+    xil_printf("PTPd: Memory: %d of %d bytes budgeted, no heap\r\n", (int)total, PTP_ARENA_BUDGET);
+#ifdef PTP_SLAVE_ONLY
+    xil_printf("PTPd: Build: slave-only (no master, BMC master or management code)\r\n");
+#else
+    xil_printf("PTPd: Build: full (define PTP_SLAVE_ONLY for a slave-only footprint)\r\n");
+#endif
+    if (__ptp_image_text_size != NULL) {
+        xil_printf("PTPd: Image: text %d, rodata %d, data %d, bss %d bytes, %d of them PTP-owned\r\n",
+            (int)(uintptr_t)__ptp_image_text_size, (int)(uintptr_t)__ptp_image_rodata_size,
+            (int)(uintptr_t)__ptp_image_data_size, (int)(uintptr_t)__ptp_image_bss_size, (int)total);
+    } else {
+        xil_printf("PTPd: Image: section sizes not available (INCLUDE ptp_footprint.ld in lscript.ld)\r\n");
+    }
+    if (total > PTP_ARENA_BUDGET) {
+        xil_printf("PTPd: WARNING: PTP memory exceeds PTP_ARENA_BUDGET, see ptpd_config.h\r\n");
+    }
+}
+
 /**
  * @brief Periodic handler for the PTP protocol stack.
  *
@@ -0,0 +1,95 @@
+#ifndef PTPD_CONFIG_H_
+#define PTPD_CONFIG_H_
+
+/*
+ * ptpd_config.h - compile-time sizes of all PTP-owned memory.
+ *
+ * Every table and buffer of the PTP daemon is a static array sized here;
+ * nothing is taken from the lwIP or C heap once the daemon runs. Override
+ * any value from the compiler command line (-DPTP_MAX_UNICAST_CLIENTS=4)
+ * and check the result in the linker map (section .bss.ptp_arena, one
+ * entry per module) or in the report ptpd_print_memory_report() prints at
+ * startup.
+ */
+
+// --- Build Profile ---
+// Define PTP_SLAVE_ONLY for an ordinary clock that can only ever be a
+// slave. The master side (Announce, Sync and Delay_Resp transmission,
+// unicast grants to slaves, the BMC's master decision) and the management
+// messages are left out of the build, and ptpd_opts.slave_only is forced
+// on. Peer delay responses stay: a P2P neighbor needs them in any state.
+
+// --- Data Sets ---
+#ifndef PTPD_DEFAULT_MAX_FOREIGN_RECORDS
+#define PTPD_DEFAULT_MAX_FOREIGN_RECORDS 5 // Foreign master records in ptp_clock_t
+#endif
+#ifndef PTP_MAX_PATHS
+#define PTP_MAX_PATHS 2 // Network interfaces PTP can receive on (redundant paths)
+#endif
+
+// --- Optional Modules ---
+#ifndef PTP_MAX_ENSEMBLE
+#define PTP_MAX_ENSEMBLE 4 // Additional masters measured in ensemble mode
+#endif
+#ifndef PTP_MAX_MONITOR
+#define PTP_MAX_MONITOR 4 // Masters of our domain watched in monitoring mode
+#endif
+#ifndef PTP_MAX_UNICAST_MASTERS
+#define PTP_MAX_UNICAST_MASTERS 4 // Entries in the slave's unicast master table
+#endif
+#ifndef PTP_MAX_UNICAST_CLIENTS
+#define PTP_MAX_UNICAST_CLIENTS 16 // Slaves a master can grant unicast service to
+#endif
+#ifndef PTP_MAX_ACCEPTABLE_MASTERS
+#define PTP_MAX_ACCEPTABLE_MASTERS 8 // Entries in the acceptable master table, a power of two
+#endif
+#ifndef PTP_MAX_AUTH_KEYS
+#define PTP_MAX_AUTH_KEYS 4 // Pre-shared keys of the AUTHENTICATION TLV
+#endif
+#ifndef PTP_MAX_DELAY_REQ_SOURCES
+#define PTP_MAX_DELAY_REQ_SOURCES 16 // Slaves a master rate limits Delay_Req for individually
+#endif
+
+// --- LMB Benchmark ---
+// Define PTP_LMB_BENCHMARK to print the LMB placement and measure the
+// cold-cache getTime() jitter at startup (main.c). The measurement flushes
+// the caches 1000 times, so leave it out of production builds.
+
+// --- Authentication Benchmark ---
+// Define PTP_AUTH_BENCHMARK to time the signing and verification of the
+// AUTHENTICATION TLV at startup (main.c, only with ptpd_opts.auth set).
+
+// --- Event Capture ---
+// Define PTP_EVENT_TMRCTR_DEVICE_ID as the XPAR_TMRCTR_n_DEVICE_ID of an
+// AXI Timer wired for capture to timestamp external events (event.c). It
+// must run from the same clock as the PTP clock's timer.
+#ifndef PTP_EVENT_QUEUE_LEN
+#define PTP_EVENT_QUEUE_LEN 16 // Captured events waiting for the main loop, a power of two
+#endif
+
+// --- Transmit Buffers ---
+// Every message is built into one of these and handed to lwIP without a
+// copy into the heap. A buffer stays taken until the MAC has sent it, so
+// allow for the frames the TX DMA ring can hold at once.
+#ifndef PTP_TX_BUFFERS
+#define PTP_TX_BUFFERS 8
+#endif
+#ifndef PTP_UDP_TX_BUFFERS
+#define PTP_UDP_TX_BUFFERS 4 // Separate pool for NTP responses
+#endif
+#ifndef PTP_TX_BUFFER_SIZE
+#define PTP_TX_BUFFER_SIZE 128 // Largest PTP message sent, headers not included
+#endif
+
+// --- Budget ---
+// Upper bound for the PTP arena (data sets + module tables + transmit
+// buffers). ptpd_print_memory_report() warns when the build exceeds it.
+#ifndef PTP_ARENA_BUDGET
+#define PTP_ARENA_BUDGET 10240
+#endif
+
+// Module state that belongs to the PTP arena. Collected into one input
+// section per object file, so the linker map lists the arena by module.
+#define PTP_ARENA __attribute__((section(".bss.ptp_arena")))
+
+#endif /* PTPD_CONFIG_H_ */
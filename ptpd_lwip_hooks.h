@@ -0,0 +1,26 @@
+#ifndef PTPD_LWIP_HOOKS_H_
+#define PTPD_LWIP_HOOKS_H_
+
+/*
+ * ptpd_lwip_hooks.h - lwIP hooks of the PTP daemon.
+ *
+ * lwIP includes this file into its own sources (ethernet.c) when the BSP's
+ * lwipopts.h, or the lwIP library's compiler flags, have
+ *
+ *   #define ETHARP_SUPPORT_VLAN 1
+ *   #define LWIP_HOOK_FILENAME  "ptpd_lwip_hooks.h"
+ *
+ * with this directory on the include path. Without them ptpd_opts.vlan_id
+ * has no effect on transmit: every frame leaves untagged.
+ */
+
+struct netif;
+struct pbuf;
+struct eth_addr;
+
+s32_t ptpd_vlan_set_hook(struct netif *netif, struct pbuf *p, const struct eth_addr *src, const struct eth_addr *dst, u16_t eth_type);
+
+// 802.1Q tag of every frame ethernet_output() sends (net.c)
+#define LWIP_HOOK_VLAN_SET(netif, p, src, dst, type) ptpd_vlan_set_hook(netif, p, src, dst, type)
+
+#endif /* PTPD_LWIP_HOOKS_H_ */
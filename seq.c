@@ -0,0 +1,158 @@
+/**
+ * @file seq.c
+ * @brief Sequence ID continuity of the parent's messages.
+ *
+ * Sync, Follow_Up and Announce carry consecutive Sequence IDs per message
+ * type, so a jump shows how many messages were lost, a repeat is a
+ * duplicate and a step back means the network reordered them. Delay_Resp
+ * answers our own Delay_Reqs instead: a request still unanswered when the
+ * next one goes out was lost, a second answer is a duplicate and an answer
+ * to an older request arrived too late to be used.
+ *
+ * Only the active path is tracked, as redundant paths legitimately deliver
+ * every message more than once. The statistics restart with every new
+ * parent.
+ */
+
+#include "../ptpd.h"
+
+static const char *seq_stream_name[SEQ_NUM_STREAMS] = { "Sync", "Follow_Up", "Announce", "Delay_Resp" };
+
+// --- Helper Functions ---
+
+/**
+ * @brief Check that a message comes from the parent, restarting the
+ *        statistics when the parent has changed.
+ * @return TRUE if the message is to be tracked.
+ */
+static bool seq_from_parent(ptp_clock_t *clock, const PtpHeader *header)
+{
+    const PortIdentity *parent = &clock->parent_ds.parent_port_identity;
+    ptp_seq_track_t *req = &clock->seq[SEQ_DELAY_RESP];
+    bool pending;
+    uint16_t last_id;
+
+    if (memcmp(header->sourcePortIdentity.clockIdentity, parent->clockIdentity, 8) != 0 ||
+        header->sourcePortIdentity.portNumber != parent->portNumber) {
+        return FALSE;
+    }
+    if (memcmp(clock->seq_parent.clockIdentity, parent->clockIdentity, 8) == 0 &&
+        clock->seq_parent.portNumber == parent->portNumber) {
+        return TRUE;
+    }
+
+    // The outstanding Delay_Req is ours, it survives the change of parent
+    pending = req->pending;
+    last_id = req->last_id;
+
+    clock->seq_parent = *parent;
+    memset(clock->seq, 0, sizeof(clock->seq));
+    clock->servo_sequence_valid = FALSE;
+
+    req->seen = pending;
+    req->pending = pending;
+    req->last_id = last_id;
+    return TRUE;
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Track one Sync, Follow_Up or Announce received on the active path.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param stream SEQ_SYNC, SEQ_FOLLOW_UP or SEQ_ANNOUNCE.
+ * @param header The header of the message.
+ * @return The number of messages lost before this one, SEQ_DUPLICATE or
+ *         SEQ_REORDERED. Messages not from the parent always return 0.
+ */
+int seq_check(ptp_clock_t *clock, uint8_t stream, const PtpHeader *header)
+{
+    ptp_seq_track_t *t = &clock->seq[stream];
+    uint16_t diff;
+
+    if (!seq_from_parent(clock, header)) {
+        return 0;
+    }
+
+    diff = header->sequenceId - t->last_id;
+    if (!t->seen) {
+        diff = 1;
+    } else if (diff == 0) {
+        t->duplicates++;
+        return SEQ_DUPLICATE;
+    } else if (diff > 0x10000 - SEQ_WINDOW) {
+        t->reordered++;
+        return SEQ_REORDERED;
+    } else if (diff >= SEQ_WINDOW) {
+        // Too far to be loss: the parent restarted its Sequence IDs
+        t->restarts++;
+        diff = 1;
+    }
+
+    t->seen = TRUE;
+    t->last_id = header->sequenceId;
+    t->received++;
+    t->lost += diff - 1;
+    return diff - 1;
+}
+
+/**
+ * @brief Note a Delay_Req sent on the active path.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param sequence_id The Sequence ID of the Delay_Req.
+ */
+void seq_request_sent(ptp_clock_t *clock, uint16_t sequence_id)
+{
+    ptp_seq_track_t *t = &clock->seq[SEQ_DELAY_RESP];
+
+    if (t->pending) {
+        t->lost++;
+    }
+    t->seen = TRUE;
+    t->pending = TRUE;
+    t->last_id = sequence_id;
+}
+
+/**
+ * @brief Track a Delay_Resp to us received on the active path.
+ * @param clock A pointer to the PTP clock data structure.
+ * @param header The header of the Delay_Resp.
+ * @return 0 for the answer to the outstanding Delay_Req, SEQ_DUPLICATE for
+ *         a repeated answer or SEQ_REORDERED for one to an older request.
+ */
+int seq_response(ptp_clock_t *clock, const PtpHeader *header)
+{
+    ptp_seq_track_t *t = &clock->seq[SEQ_DELAY_RESP];
+
+    if (!seq_from_parent(clock, header) || !t->seen) {
+        return 0;
+    }
+
+    if (header->sequenceId != t->last_id) {
+        t->reordered++;
+        return SEQ_REORDERED;
+    }
+    if (!t->pending) {
+        t->duplicates++;
+        return SEQ_DUPLICATE;
+    }
+    t->pending = FALSE;
+    t->received++;
+    return 0;
+}
+
+/**
+ * @brief Print the continuity statistics of the parent's messages.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void seq_print_stats(ptp_clock_t *clock)
+{
+    uint8_t i;
+
+    for (i = 0; i < SEQ_NUM_STREAMS; ++i) {
+        ptp_seq_track_t *t = &clock->seq[i];
+        xil_printf("PTPd: %s: received %d, lost %d, duplicates %d, reordered %d, restarts %d\r\n",
+            seq_stream_name[i], t->received, t->lost, t->duplicates, t->reordered, t->restarts);
+    }
+}
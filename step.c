@@ -0,0 +1,174 @@
+/**
+ * @file step.c
+ * @brief Detection and handling of time steps of the parent.
+ *
+ * Between two Syncs the parent's origin timestamps (T1) and our receive
+ * timestamps (T2) must advance by the same amount, up to our own servo
+ * adjustments and the frequency error. When they do not, one of the two
+ * clocks jumped. If T2 advanced by the nominal Sync interval and T1 did
+ * not, the parent stepped (grandmaster restart, GNSS reacquisition); if
+ * T1 did and T2 did not, our own clock is at fault and is put right at
+ * once.
+ *
+ * A step of the parent is not followed straight away. The servo is held
+ * and the step must be confirmed by gm_step_confirmations consistent Syncs
+ * before the local clock follows it (PTP_GM_STEP_FOLLOW), or it is only
+ * followed once the application calls step_accept() (PTP_GM_STEP_HOLD). A
+ * parent that jumps back within that time costs no step at all, so a
+ * flapping grandmaster cannot make the local clock oscillate. Every
+ * decision is posted to ptp_alert_queue.
+ */
+
+#include "../ptpd.h"
+#include <stdlib.h> // For llabs()
+
+extern ptpd_opts ptp_opts;
+extern sys_mbox_t ptp_alert_queue;
+
+// --- Helper Functions ---
+
+static int64_t time_to_ns(const TimeInternal *t)
+{
+    return t->seconds * 1000000000LL + t->nanoseconds;
+}
+
+/**
+ * @brief Tell the application about a step decision.
+ */
+static void step_alert(uint32_t alert)
+{
+    // Never block the protocol on a full queue; the state stays in the clock
+    sys_mbox_trypost(&ptp_alert_queue, (void *)(uintptr_t)alert);
+}
+
+/**
+ * @brief Forget the reference sample and any pending step.
+ */
+static void step_reset(ptp_clock_t *clock)
+{
+    clock->gm_step_baseline_valid = FALSE;
+    clock->gm_step_local_adj = 0;
+    clock->gm_step_state = GM_STEP_NONE;
+    clock->gm_step_size = 0;
+    clock->gm_step_confirmations = 0;
+}
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Check a complete Sync from the parent for a time step.
+ *
+ * Call for every Sync of the active path before the servo sees it.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ * @param t1 The Sync's precise origin timestamp, corrections applied.
+ * @param t2 The Sync's receive timestamp.
+ * @param sequence_id The Sync's Sequence ID.
+ * @param interval_ns The parent's Sync interval.
+ * @return GM_STEP_USE to feed the servo, GM_STEP_SKIP while holding, or
+ *         GM_STEP_JUMP to step the local clock to the parent now.
+ */
+uint8_t step_check(ptp_clock_t *clock, const TimeInternal *t1, const TimeInternal *t2,
+                   uint16_t sequence_id, int64_t interval_ns)
+{
+    const PortIdentity *parent = &clock->parent_ds.parent_port_identity;
+    uint16_t intervals = sequence_id - clock->gm_step_sequence_id;
+    bool valid = clock->gm_step_baseline_valid;
+    int64_t d1, d2, mismatch, expected;
+
+    // Another parent has its own time; a held step does not carry over
+    if (memcmp(clock->gm_step_parent.clockIdentity, parent->clockIdentity, 8) != 0 ||
+        clock->gm_step_parent.portNumber != parent->portNumber) {
+        if (clock->gm_step_state != GM_STEP_NONE) {
+            xil_printf("PTPd: New parent, pending time step dropped\r\n");
+            step_alert(PTP_ALERT_GM_STEP_CLEARED);
+        }
+        clock->gm_step_parent = *parent;
+        step_reset(clock);
+        valid = FALSE;
+    }
+
+    d1 = time_to_ns(t1) - time_to_ns(&clock->gm_step_t1);
+    d2 = time_to_ns(t2) - time_to_ns(&clock->gm_step_t2) - clock->gm_step_local_adj;
+
+    clock->gm_step_t1 = *t1;
+    clock->gm_step_t2 = *t2;
+    clock->gm_step_sequence_id = sequence_id;
+    clock->gm_step_local_adj = 0;
+    clock->gm_step_baseline_valid = TRUE;
+
+    // Too far apart to compare, start over from this sample
+    if (!valid || intervals == 0 || intervals >= SEQ_WINDOW) {
+        return (clock->gm_step_state == GM_STEP_NONE) ? GM_STEP_USE : GM_STEP_SKIP;
+    }
+
+    expected = interval_ns * intervals;
+    mismatch = d1 - d2; // How far the parent moved against us
+
+    if (llabs(mismatch) < ptp_opts.gm_step_threshold_ns) {
+        if (clock->gm_step_state == GM_STEP_NONE) {
+            return GM_STEP_USE;
+        }
+        if (clock->gm_step_confirmations < 255) {
+            clock->gm_step_confirmations++;
+        }
+        if (clock->gm_step_state == GM_STEP_ACCEPTED ||
+            (clock->gm_step_state == GM_STEP_PENDING && ptp_opts.gm_step_policy == PTP_GM_STEP_FOLLOW &&
+             clock->gm_step_confirmations >= ptp_opts.gm_step_confirmations)) {
+            xil_printf("PTPd: Following time step of the parent\r\n");
+            step_alert(PTP_ALERT_GM_STEP_FOLLOWED);
+            step_reset(clock);
+            return GM_STEP_JUMP;
+        }
+        if (clock->gm_step_state == GM_STEP_PENDING && ptp_opts.gm_step_policy == PTP_GM_STEP_HOLD &&
+            clock->gm_step_confirmations >= ptp_opts.gm_step_confirmations) {
+            xil_printf("PTPd: Time step of the parent confirmed, holding until step_accept()\r\n");
+            step_alert(PTP_ALERT_GM_STEP_HELD);
+            clock->gm_step_state = GM_STEP_HELD;
+        }
+        return GM_STEP_SKIP;
+    }
+
+    // Our receive times kept the nominal pace but the parent's did not.
+    // When neither did, the parent is blamed: holding is safer than stepping.
+    if (llabs(d2 - expected) >= ptp_opts.gm_step_threshold_ns &&
+        llabs(d1 - expected) < ptp_opts.gm_step_threshold_ns) {
+        xil_printf("PTPd: Local clock jumped by %d ns, correcting\r\n", (int32_t)-mismatch);
+        step_alert(PTP_ALERT_LOCAL_TIME_FAULT);
+        return (clock->gm_step_state == GM_STEP_NONE) ? GM_STEP_JUMP : GM_STEP_SKIP;
+    }
+
+    clock->gm_step_size += mismatch;
+    clock->gm_step_confirmations = 0;
+
+    if (clock->gm_step_state != GM_STEP_NONE && llabs(clock->gm_step_size) < ptp_opts.gm_step_threshold_ns) {
+        xil_printf("PTPd: Parent returned to its previous time\r\n");
+        step_alert(PTP_ALERT_GM_STEP_CLEARED);
+        step_reset(clock);
+        clock->gm_step_baseline_valid = TRUE;
+        return GM_STEP_USE;
+    }
+
+    xil_printf("PTPd: Parent time stepped by %d ms, holding the servo\r\n", (int32_t)(clock->gm_step_size / 1000000));
+    if (clock->gm_step_state == GM_STEP_NONE) {
+        step_alert(PTP_ALERT_GM_STEP_DETECTED);
+    }
+    clock->gm_step_state = GM_STEP_PENDING;
+    return GM_STEP_SKIP;
+}
+
+/**
+ * @brief Let the local clock follow a held time step of the parent.
+ *
+ * For the PTP_GM_STEP_HOLD policy, once the application has decided the
+ * new time is right. The step is taken with the next consistent Sync.
+ *
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void step_accept(ptp_clock_t *clock)
+{
+    if (clock->gm_step_state != GM_STEP_NONE) {
+        clock->gm_step_state = GM_STEP_ACCEPTED;
+    }
+}
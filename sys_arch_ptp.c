@@ -1,15 +1,23 @@
 #include "../ptpd.h"
 #include "xtmrctr.h" // AXI Timer driver header
+#include "xil_cache.h"
+#include "mb_interface.h" // microblaze_disable_interrupts()
 
 // --- Hardware Timer Instance ---
 // This driver instance will be used to access the timer hardware.
-static XTmrCtr HwTimer;
+PTP_LMB_DATA static XTmrCtr HwTimer;
 
 // --- Software Clock Adjustment ---
 // This variable stores the fine-grained offset calculated by the PTP servo.
 // It is applied to the raw hardware time to "slew" the clock without
 // causing abrupt jumps.
-static int64_t time_offset_ns = 0;
+PTP_LMB_DATA static int64_t time_offset_ns = 0;
+
+#ifdef PTP_USE_LMB
+// Section bounds, defined by ptp_lmb.ld
+extern char __ptp_lmb_text_start[], __ptp_lmb_text_end[];
+extern char __ptp_lmb_data_start[], __ptp_lmb_data_end[];
+#endif
 
 /**
  * @brief Initialize the hardware timer for PTP.
@@ -64,41 +72,82 @@ void ptpd_hw_timer_init(void)
 
 
 /**
- * @brief Get the current time from the hardware clock.
- *
- * Reads the 64-bit value from the cascaded AXI timers and converts it
- * into the TimeInternal format (seconds and nanoseconds) required by PTPd.
- *
- * @param time A pointer to a TimeInternal structure to be filled.
+ * @brief Read the 64-bit tick count of the cascaded AXI timers.
  */
-void getTime(TimeInternal *time)
+PTP_LMB_TEXT static inline u64_t read_ticks(void)
 {
     u32_t high1, high2, low;
-    u64_t current_ticks;
-    u64_t current_nanoseconds;
 
     // This loop ensures a consistent read of the 64-bit value from two
-    // separate 32-bit registers, avoiding rollover issues.
+    // separate 32-bit registers, avoiding rollover issues. The registers are
+    // read directly rather than through XTmrCtr_GetValue(), which lives in
+    // the driver library and so outside the LMB.
     do {
-        high1 = XTmrCtr_GetValue(&HwTimer, 1); // Read high bits
-        low   = XTmrCtr_GetValue(&HwTimer, 0); // Read low bits
-        high2 = XTmrCtr_GetValue(&HwTimer, 1); // Read high bits again
+        high1 = XTmrCtr_ReadReg(HwTimer.BaseAddress, 1, XTC_TCR_OFFSET); // Read high bits
+        low   = XTmrCtr_ReadReg(HwTimer.BaseAddress, 0, XTC_TCR_OFFSET); // Read low bits
+        high2 = XTmrCtr_ReadReg(HwTimer.BaseAddress, 1, XTC_TCR_OFFSET); // Read high bits again
     } while (high1 != high2); // If high bits changed, a rollover occurred, so retry
 
-    // Combine into a 64-bit tick value
-    current_ticks = ((u64_t)high2 << 32) | low;
+    return ((u64_t)high2 << 32) | low;
+}
+
+/**
+ * @brief Convert a tick count and a servo offset to PTP time.
+ */
+PTP_LMB_TEXT static inline void ticks_to_time(u64_t ticks, int64_t offset_ns, TimeInternal *time)
+{
+    u64_t nanoseconds;
 
     // Convert hardware ticks to nanoseconds.
     // This assumes the AXI Timer is clocked at the processor frequency.
     // ** IMPORTANT: Verify XPAR_CPU_CORE_CLOCK_FREQ_HZ matches your timer's clock **
-    current_nanoseconds = (current_ticks * 1000000000ULL) / XPAR_CPU_CORE_CLOCK_FREQ_HZ;
+    nanoseconds = (ticks * 1000000000ULL) / XPAR_CPU_CORE_CLOCK_FREQ_HZ;
 
     // Apply the software clock adjustment from the servo
-    current_nanoseconds += time_offset_ns;
+    nanoseconds += offset_ns;
 
     // Populate the TimeInternal structure
-    time->seconds = current_nanoseconds / 1000000000ULL;
-    time->nanoseconds = current_nanoseconds % 1000000000ULL;
+    time->seconds = nanoseconds / 1000000000ULL;
+    time->nanoseconds = nanoseconds % 1000000000ULL;
+}
+
+/**
+ * @brief Get the current time from the hardware clock.
+ *
+ * Reads the 64-bit value from the cascaded AXI timers and converts it
+ * into the TimeInternal format (seconds and nanoseconds) required by PTPd.
+ *
+ * @param time A pointer to a TimeInternal structure to be filled.
+ */
+PTP_LMB_TEXT void getTime(TimeInternal *time)
+{
+    ticks_to_time(read_ticks(), time_offset_ns, time);
+}
+
+/**
+ * @brief Sample the clock model: the raw tick count and the servo offset.
+ *
+ * For the capture ISR in event.c, which converts the ticks to PTP time
+ * later with ptpd_hw_ticks_to_time() and the offset valid now.
+ *
+ * @param offset_ns Receives the servo offset.
+ * @return The 64-bit tick count.
+ */
+PTP_LMB_TEXT u64_t ptpd_hw_read_ticks(int64_t *offset_ns)
+{
+    *offset_ns = time_offset_ns;
+    return read_ticks();
+}
+
+/**
+ * @brief Convert a sample of ptpd_hw_read_ticks() to PTP time.
+ * @param ticks The tick count.
+ * @param offset_ns The servo offset sampled with it.
+ * @param time Receives the PTP time.
+ */
+void ptpd_hw_ticks_to_time(u64_t ticks, int64_t offset_ns, TimeInternal *time)
+{
+    ticks_to_time(ticks, offset_ns, time);
 }
 
 /**
@@ -149,12 +198,64 @@ void setTime(const TimeInternal *time)
  * (Note: The reference ptpd implementation passes nanoseconds here).
  * @return TRUE
  */
-bool adjTime(int32_t adj_ns)
+PTP_LMB_TEXT bool adjTime(int32_t adj_ns)
 {
     // Add the adjustment from the servo to our software offset.
     // This avoids large jumps in time by applying a continuous correction
-    // in the getTime() function.
+    // in the getTime() function. The event capture ISR samples the offset,
+    // so it must not see the two halves of the update apart.
+    microblaze_disable_interrupts();
     time_offset_ns += adj_ns;
+    microblaze_enable_interrupts();
 
     return TRUE;
 }
+
+/**
+ * @brief Print how much of the LMB the PTP code and data occupy.
+ */
+void ptpd_hw_print_lmb_usage(void)
+{
+#ifdef PTP_USE_LMB
+    xil_printf("PTPd: LMB placement: code %d bytes, data %d bytes\r\n",
+        (int)(__ptp_lmb_text_end - __ptp_lmb_text_start), (int)(__ptp_lmb_data_end - __ptp_lmb_data_start));
+#else
+    xil_printf("PTPd: LMB placement disabled (PTP_USE_LMB not defined)\r\n");
+#endif
+}
+
+/**
+ * @brief Measure the spread of the getTime() latency with cold caches.
+ *
+ * Each sample empties the caches, as a burst of lwIP traffic would, and
+ * times one getTime() call with the next. The spread (max - min) is the
+ * jitter the memory system adds to every software timestamp; compare a
+ * build with PTP_USE_LMB against one without.
+ *
+ * @param samples Number of measurements.
+ */
+void ptpd_hw_measure_jitter(uint32_t samples)
+{
+    TimeInternal a, b;
+    int32_t latency, min = 0x7FFFFFFF, max = 0;
+    int64_t sum = 0;
+    uint32_t i;
+
+    if (samples == 0) {
+        return;
+    }
+
+    for (i = 0; i < samples; ++i) {
+        Xil_DCacheFlush();
+        Xil_ICacheInvalidate();
+        getTime(&a);
+        getTime(&b);
+        latency = (int32_t)((b.seconds - a.seconds) * 1000000000LL + (b.nanoseconds - a.nanoseconds));
+        if (latency < min) min = latency;
+        if (latency > max) max = latency;
+        sum += latency;
+    }
+
+    xil_printf("PTPd: getTime() latency over %d cold-cache samples: min %d ns, mean %d ns, max %d ns, jitter %d ns\r\n",
+        samples, min, (int32_t)(sum / samples), max, max - min);
+}
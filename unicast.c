@@ -0,0 +1,611 @@
+/**
+ * @file unicast.c
+ * @brief Unicast message negotiation (IEEE 1588-2008 16.1, ITU-T G.8275.2).
+ *
+ * A G.8275.2 slave has no multicast to listen to. It asks every master in
+ * its unicast master table for Announce, and the master the BMC selected
+ * also for Sync and Delay_Resp. Every grant lasts for the requested
+ * duration and is renewed before it runs out, or cancelled once it is no
+ * longer needed. With ptpd_opts.sync_rate_adaptive the Sync and Delay_Resp
+ * rates asked of the parent follow the measured offset noise: a faster
+ * rate while it is high, a slower one once it is low.
+ *
+ * As a master, the port grants such requests to up to
+ * PTP_MAX_UNICAST_CLIENTS slaves and sends each one its own Announce and
+ * Sync/Follow_Up stream, at the rate and with the Sequence IDs of that
+ * grant. Each client slot sends at its own fixed phase of the interval, so
+ * the streams of many slaves do not leave in one burst and queue behind
+ * each other. The phase has protocol tick granularity (1/PTP_TICK_RATE_HZ):
+ * at an interval of one tick (log interval -7 at 128 Hz) every stream
+ * shares the same tick and there is nothing to stagger, and at two or four
+ * ticks only that many phases exist. Within a tick the slot served first
+ * rotates, so the queueing delay of a burst is shared by all slaves
+ * instead of always falling on the same ones. A PTP_SLAVE_ONLY build
+ * denies every request.
+ */
+
+#include "../ptpd.h"
+
+extern ptpd_opts ptp_opts;
+
+#define SERVICE_ANNOUNCE    0
+#define SERVICE_SYNC        1
+#define SERVICE_DELAY_RESP  2
+#define NUM_SERVICES        3
+
+#define UNICAST_RETRY_TICKS     (2 * PTP_TICK_RATE_HZ) // After a denial or an unanswered request
+#define UNICAST_MAX_DURATION    1000 // s, longest grant given (G.8275.2 Table A.3)
+#define UNICAST_MIN_LOG_INTERVAL (-7) // Fastest rate granted: 128 messages/s
+#define UNICAST_ADAPT_TICKS     (16 * PTP_TICK_RATE_HZ) // Between two rate decisions, lets the filters settle
+
+static const uint8_t service_message_type[NUM_SERVICES] = { ANNOUNCE_MSG, SYNC_MSG, DELAY_RESP_MSG };
+
+// A service requested from one master (slave side)
+typedef struct {
+    bool granted;
+    int8_t log_interval;
+    int32_t renew_timer;   // Ticks until the next REQUEST
+    int32_t expiry_timer;  // Ticks until the grant runs out
+} unicast_request_t;
+
+// One entry of the unicast master table
+typedef struct {
+    bool identity_known;
+    PortIdentity port_identity; // Learnt from its first message
+    unicast_request_t service[NUM_SERVICES];
+} unicast_master_t;
+
+// A service granted to one slave (master side)
+typedef struct {
+    bool granted;
+    int8_t log_interval;
+    int32_t expiry_timer;  // Ticks until the grant runs out
+    uint32_t phase;        // Tick within the interval the stream is sent on
+    uint16_t sequence_id;
+} unicast_grant_t;
+
+typedef struct {
+    bool in_use;
+    ip_addr_t address;
+    PortIdentity port_identity;
+    unicast_grant_t service[NUM_SERVICES];
+} unicast_client_t;
+
+PTP_ARENA static unicast_master_t masters[PTP_MAX_UNICAST_MASTERS];
+#ifndef PTP_SLAVE_ONLY
+PTP_ARENA static unicast_client_t clients[PTP_MAX_UNICAST_CLIENTS];
+const uint32_t unicast_arena_bytes = sizeof(masters) + sizeof(clients);
+#else
+const uint32_t unicast_arena_bytes = sizeof(masters);
+#endif
+static ptp_clock_t *unicast_clock;
+#ifndef PTP_SLAVE_ONLY
+static uint32_t master_ticks; // Free-running tick count the client streams are phased to
+#endif
+static int8_t adaptive_log_interval; // Sync and Delay_Resp interval asked of the parent
+static int32_t adapt_timer;
+
+static const PortIdentity all_ports = {
+    { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF }, 0xFFFF
+};
+
+// --- Helper Functions ---
+
+/**
+ * @brief Map a messageType to its service index.
+ * @return The service index, or -1 if the type cannot be negotiated.
+ */
+static int service_index(uint8_t message_type)
+{
+    int s;
+
+    for (s = 0; s < NUM_SERVICES; ++s) {
+        if (service_message_type[s] == message_type) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Find the unicast master table entry of an address.
+ * @return The table index, or -1 if the address is not in the table.
+ */
+static int find_master(const ip_addr_t *addr)
+{
+    int i;
+
+    for (i = 0; addr != NULL && i < ptp_opts.num_unicast_masters; ++i) {
+        if (ip_addr_cmp(&ptp_opts.unicast_masters[i].address, addr)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#ifndef PTP_SLAVE_ONLY
+/**
+ * @brief Find the client record of an address, optionally creating it.
+ * @return The client, or NULL if not found (and no free record).
+ */
+static unicast_client_t *find_client(const ip_addr_t *addr, bool create)
+{
+    unicast_client_t *free_slot = NULL;
+    int i;
+
+    for (i = 0; i < PTP_MAX_UNICAST_CLIENTS; ++i) {
+        if (clients[i].in_use && ip_addr_cmp(&clients[i].address, addr)) {
+            return &clients[i];
+        }
+        if (!clients[i].in_use && free_slot == NULL) {
+            free_slot = &clients[i];
+        }
+    }
+    if (!create || free_slot == NULL) {
+        return NULL;
+    }
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->in_use = TRUE;
+    ip_addr_copy(free_slot->address, *addr);
+    return free_slot;
+}
+
+/**
+ * @brief Phase of a client's stream within its interval.
+ *
+ * Slots are placed in bit-reversed order (0, 1/2, 1/4, 3/4, 1/8 ... of the
+ * interval), so however many are taken their Syncs stay close to evenly
+ * spaced. Announces sit halfway between the Syncs of neighbouring slots.
+ * Phases are whole ticks, so an interval of one tick gives every slot
+ * phase 0: no staggering at the fastest rates, see master_tick().
+ *
+ * @param c The client slot.
+ * @param s The service.
+ * @param ticks The interval in ticks.
+ * @return The tick within the interval the stream is sent on.
+ */
+static uint32_t grant_phase(int c, int s, uint32_t ticks)
+{
+    uint32_t fraction = 0; // 1/65536 of the interval
+    int bit;
+
+    for (bit = 0; (1 << bit) < PTP_MAX_UNICAST_CLIENTS; ++bit) {
+        if (c & (1 << bit)) {
+            fraction |= 0x8000 >> bit;
+        }
+    }
+    if (s == SERVICE_ANNOUNCE) {
+        fraction |= 0x8000 >> bit;
+    }
+    return (uint32_t)(((uint64_t)ticks * fraction) >> 16);
+}
+#endif
+
+/**
+ * @brief Send a Signaling message with one negotiation TLV.
+ */
+static void send_signaling(const ip_addr_t *addr, const PortIdentity *target, uint16_t tlv_type,
+                           uint8_t message_type, int8_t log_interval, uint32_t duration)
+{
+    uint8_t buf[56];
+    int len;
+
+    len = msg_pack_signaling(buf, unicast_clock, target, tlv_type, message_type, log_interval, duration);
+    net_send_general_to(buf, len, addr);
+}
+
+/**
+ * @brief Check whether the slave currently needs a service from a master.
+ *
+ * Announce is wanted from every master so the BMC can choose; Sync and
+ * Delay_Resp only from the parent while the port is synchronizing.
+ */
+static bool service_wanted(ptp_clock_t *clock, int m, int s)
+{
+    if (s == SERVICE_ANNOUNCE) {
+        return TRUE;
+    }
+    if (clock->port_ds.port_state != PTP_SLAVE && clock->port_ds.port_state != PTP_UNCALIBRATED) {
+        return FALSE;
+    }
+    if (s == SERVICE_DELAY_RESP && ptp_opts.syntonize_only) {
+        return FALSE;
+    }
+    return masters[m].identity_known &&
+           memcmp(&masters[m].port_identity, &clock->parent_ds.parent_port_identity, sizeof(PortIdentity)) == 0;
+}
+
+/**
+ * @brief The log interval the slave asks for, per service.
+ */
+static int8_t requested_log_interval(ptp_clock_t *clock, int s)
+{
+    if (ptp_opts.sync_rate_adaptive && s != SERVICE_ANNOUNCE) {
+        return adaptive_log_interval;
+    }
+    switch (s) {
+        case SERVICE_ANNOUNCE: return clock->port_ds.log_announce_interval;
+        case SERVICE_SYNC:     return clock->port_ds.log_sync_interval;
+        default:               return clock->port_ds.log_min_delay_req_interval;
+    }
+}
+
+/**
+ * @brief Move the Sync and Delay_Resp rates asked of the parent with the noise.
+ *
+ * The smoothed change in offset of the active path holds both the packet
+ * delay variation and the servo's noise. Above sync_rate_jitter_high_ns
+ * the rate is doubled, below sync_rate_jitter_low_ns it is halved, within
+ * sync_interval_min/max. A changed rate is asked for at once; the parent's
+ * grant replaces the running one.
+ */
+static void adapt_rate(ptp_clock_t *clock)
+{
+    int32_t jitter = clock->path[clock->active_path].offset_jitter;
+    int8_t log_interval = adaptive_log_interval;
+    int m;
+
+    if (!ptp_opts.sync_rate_adaptive || --adapt_timer > 0) {
+        return;
+    }
+    adapt_timer = UNICAST_ADAPT_TICKS;
+
+    // The jitter of an unlocked servo says nothing about the network
+    if (clock->port_ds.port_state != PTP_SLAVE) {
+        return;
+    }
+
+    if (jitter > ptp_opts.sync_rate_jitter_high_ns && log_interval > ptp_opts.sync_interval_min) {
+        log_interval--;
+    } else if (jitter < ptp_opts.sync_rate_jitter_low_ns && log_interval < ptp_opts.sync_interval_max) {
+        log_interval++;
+    } else {
+        return;
+    }
+
+    xil_printf("PTPd: Unicast: offset jitter %d ns, asking for log interval %d\r\n", jitter, log_interval);
+    adaptive_log_interval = log_interval;
+    for (m = 0; m < ptp_opts.num_unicast_masters; ++m) {
+        masters[m].service[SERVICE_SYNC].renew_timer = 0;
+        masters[m].service[SERVICE_DELAY_RESP].renew_timer = 0;
+    }
+}
+
+/**
+ * @brief Request, renew and cancel the slave's grants (unicast master table).
+ */
+static void slave_tick(ptp_clock_t *clock)
+{
+    int m, s;
+
+    for (m = 0; m < ptp_opts.num_unicast_masters; ++m) {
+        const ip_addr_t *addr = &ptp_opts.unicast_masters[m].address;
+        const PortIdentity *target = masters[m].identity_known ? &masters[m].port_identity : &all_ports;
+
+        for (s = 0; s < NUM_SERVICES; ++s) {
+            unicast_request_t *req = &masters[m].service[s];
+
+            if (req->expiry_timer > 0 && --req->expiry_timer == 0) {
+                req->granted = FALSE;
+            }
+            if (req->renew_timer > 0) {
+                req->renew_timer--;
+            }
+
+            if (!service_wanted(clock, m, s)) {
+                if (req->granted) {
+                    send_signaling(addr, target, TLV_CANCEL_UNICAST_TRANSMISSION, service_message_type[s], 0, 0);
+                    req->granted = FALSE;
+                    req->expiry_timer = 0;
+                }
+                req->renew_timer = 0; // Ask at once when wanted again
+                continue;
+            }
+
+            if (req->renew_timer == 0) {
+                req->log_interval = requested_log_interval(clock, s);
+                send_signaling(addr, target, TLV_REQUEST_UNICAST_TRANSMISSION, service_message_type[s],
+                               req->log_interval, PTP_UNICAST_GRANT_DURATION);
+                req->renew_timer = UNICAST_RETRY_TICKS;
+            }
+        }
+    }
+}
+
+#ifndef PTP_SLAVE_ONLY
+/**
+ * @brief Expire grants and send the Announce/Sync streams of every slave.
+ */
+static void master_tick(ptp_clock_t *clock)
+{
+    uint8_t buf[76];
+    TimeInternal sync_ts;
+    uint32_t ticks;
+    int i, c, s, len;
+
+    master_ticks++;
+    for (i = 0; i < PTP_MAX_UNICAST_CLIENTS; ++i) {
+        // Streams phased into the same tick leave back to back; rotate who goes first
+        c = (int)((master_ticks + i) % PTP_MAX_UNICAST_CLIENTS);
+        unicast_client_t *client = &clients[c];
+        bool active = FALSE;
+
+        if (!client->in_use) {
+            continue;
+        }
+
+        for (s = 0; s < NUM_SERVICES; ++s) {
+            unicast_grant_t *grant = &client->service[s];
+
+            if (grant->granted && --grant->expiry_timer <= 0) {
+                grant->granted = FALSE;
+            }
+            if (!grant->granted) {
+                continue;
+            }
+            active = TRUE;
+
+            if (s == SERVICE_DELAY_RESP || clock->port_ds.port_state != PTP_MASTER) {
+                continue;
+            }
+            // Intervals are a power of two ticks long, so the mask keeps the phase across wraps
+            ticks = timer_log_interval_ticks(grant->log_interval);
+            if (((master_ticks - grant->phase) & (ticks - 1)) != 0) {
+                continue;
+            }
+
+            if (s == SERVICE_ANNOUNCE) {
+                len = msg_pack_announce(buf, clock);
+                msg_set_unicast(buf, grant->sequence_id++, grant->log_interval);
+                net_send_general_to(buf, len, &client->address);
+            } else {
+                getTime(&sync_ts);
+                msg_pack_sync(buf, clock, &sync_ts);
+                msg_set_unicast(buf, grant->sequence_id, grant->log_interval);
+                net_send_event_to(buf, 44, &client->address);
+                net_get_tx_timestamp(&sync_ts);
+
+                if (clock->default_ds.two_step_flag) {
+                    len = msg_pack_follow_up(buf, clock, &sync_ts);
+                    msg_set_unicast(buf, grant->sequence_id, grant->log_interval);
+                    net_send_general_to(buf, len, &client->address);
+                }
+                grant->sequence_id++;
+            }
+        }
+
+        if (!active) {
+            client->in_use = FALSE;
+        }
+    }
+}
+#endif
+
+
+// --- Public Functions ---
+
+/**
+ * @brief Forget all grants, in both directions.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void unicast_init(ptp_clock_t *clock)
+{
+    unicast_clock = clock;
+    memset(masters, 0, sizeof(masters));
+    adaptive_log_interval = clock->port_ds.log_sync_interval;
+    if (adaptive_log_interval < ptp_opts.sync_interval_min) {
+        adaptive_log_interval = ptp_opts.sync_interval_min;
+    } else if (adaptive_log_interval > ptp_opts.sync_interval_max) {
+        adaptive_log_interval = ptp_opts.sync_interval_max;
+    }
+    adapt_timer = UNICAST_ADAPT_TICKS;
+#ifndef PTP_SLAVE_ONLY
+    memset(clients, 0, sizeof(clients));
+#endif
+}
+
+/**
+ * @brief Periodic unicast negotiation and transmission, called every protocol tick.
+ * @param clock A pointer to the PTP clock data structure.
+ */
+void unicast_tick(ptp_clock_t *clock)
+{
+    adapt_rate(clock);
+    slave_tick(clock);
+#ifndef PTP_SLAVE_ONLY
+    master_tick(clock);
+#endif
+}
+
+/**
+ * @brief Handle a REQUEST_UNICAST_TRANSMISSION TLV from a slave.
+ *
+ * The request is granted as asked, with the duration capped at
+ * UNICAST_MAX_DURATION, or denied with a zero duration if this port is not
+ * a master, the rate is too high or the client table is full.
+ *
+ * @param header The header of the Signaling message.
+ * @param message_type The message type requested.
+ * @param log_interval The requested logInterMessagePeriod.
+ * @param duration The requested duration in seconds.
+ */
+void unicast_handle_request(const PtpHeader *header, uint8_t message_type, int8_t log_interval, uint32_t duration)
+{
+    const ip_addr_t *addr = net_rx_addr();
+    unicast_client_t *client = NULL;
+    int s = service_index(message_type);
+
+    if (addr == NULL) {
+        return; // Negotiation is only supported over UDP
+    }
+
+#ifndef PTP_SLAVE_ONLY
+    if (s >= 0 && unicast_clock->port_ds.port_state == PTP_MASTER && log_interval >= UNICAST_MIN_LOG_INTERVAL) {
+        client = find_client(addr, TRUE);
+    }
+#endif
+    if (client == NULL) {
+        send_signaling(addr, &header->sourcePortIdentity, TLV_GRANT_UNICAST_TRANSMISSION, message_type, log_interval, 0);
+        return;
+    }
+
+    if (duration > UNICAST_MAX_DURATION) {
+        duration = UNICAST_MAX_DURATION;
+    }
+    client->port_identity = header->sourcePortIdentity;
+#ifndef PTP_SLAVE_ONLY
+    // The stream starts at the slot's phase, within one interval
+    client->service[s].phase = grant_phase((int)(client - clients), s, timer_log_interval_ticks(log_interval));
+#endif
+    client->service[s].granted = (duration != 0);
+    client->service[s].log_interval = log_interval;
+    client->service[s].expiry_timer = (int32_t)duration * PTP_TICK_RATE_HZ;
+
+    send_signaling(addr, &header->sourcePortIdentity, TLV_GRANT_UNICAST_TRANSMISSION, message_type, log_interval, duration);
+}
+
+/**
+ * @brief Handle a GRANT_UNICAST_TRANSMISSION TLV from a master.
+ *
+ * A grant is renewed when three quarters of its duration have passed. A
+ * denial (zero duration) is retried after UNICAST_RETRY_TICKS.
+ *
+ * @param header The header of the Signaling message.
+ * @param message_type The message type granted.
+ * @param log_interval The granted logInterMessagePeriod.
+ * @param duration The granted duration in seconds, 0 if denied.
+ */
+void unicast_handle_grant(const PtpHeader *header, uint8_t message_type, int8_t log_interval, uint32_t duration)
+{
+    int m = find_master(net_rx_addr());
+    int s = service_index(message_type);
+    unicast_request_t *req;
+
+    if (m < 0 || s < 0) {
+        return;
+    }
+    req = &masters[m].service[s];
+    masters[m].port_identity = header->sourcePortIdentity;
+    masters[m].identity_known = TRUE;
+
+    if (duration == 0) {
+        req->granted = FALSE;
+        req->expiry_timer = 0;
+        req->renew_timer = UNICAST_RETRY_TICKS;
+        return;
+    }
+
+    req->granted = TRUE;
+    req->log_interval = log_interval;
+    req->expiry_timer = (int32_t)duration * PTP_TICK_RATE_HZ;
+    req->renew_timer = req->expiry_timer - req->expiry_timer / 4;
+
+    if (s == SERVICE_DELAY_RESP) {
+        unicast_clock->port_ds.log_min_delay_req_interval = log_interval;
+    }
+}
+
+/**
+ * @brief Handle a CANCEL_UNICAST_TRANSMISSION TLV from a master or a slave.
+ *
+ * The grant is dropped and the cancel acknowledged. A slave asks its
+ * master again after UNICAST_RETRY_TICKS.
+ *
+ * @param header The header of the Signaling message.
+ * @param message_type The message type cancelled.
+ */
+void unicast_handle_cancel(const PtpHeader *header, uint8_t message_type)
+{
+    const ip_addr_t *addr = net_rx_addr();
+    int s = service_index(message_type);
+    int m;
+
+    if (addr == NULL || s < 0) {
+        return;
+    }
+
+#ifndef PTP_SLAVE_ONLY
+    {
+        unicast_client_t *client = find_client(addr, FALSE);
+
+        if (client != NULL) {
+            client->service[s].granted = FALSE;
+        }
+    }
+#endif
+    m = find_master(addr);
+    if (m >= 0) {
+        masters[m].service[s].granted = FALSE;
+        masters[m].service[s].expiry_timer = 0;
+        masters[m].service[s].renew_timer = UNICAST_RETRY_TICKS;
+    }
+
+    send_signaling(addr, &header->sourcePortIdentity, TLV_ACKNOWLEDGE_CANCEL_UNICAST_TRANSMISSION, message_type, 0, 0);
+}
+
+/**
+ * @brief Handle an ACKNOWLEDGE_CANCEL_UNICAST_TRANSMISSION TLV.
+ *
+ * Our grants are dropped as soon as we send CANCEL, so nothing is left to do.
+ *
+ * @param header The header of the Signaling message.
+ * @param message_type The message type whose cancel was acknowledged.
+ */
+void unicast_handle_ack_cancel(const PtpHeader *header, uint8_t message_type)
+{
+}
+
+/**
+ * @brief Look up the sender of an Announce in the unicast master table.
+ * @param addr The sender's address (NULL for PTP over Ethernet).
+ * @param local_priority Updated with the entry's localPriority, if found.
+ * @return TRUE if the address is in the table, FALSE otherwise.
+ */
+bool unicast_master_lookup(const ip_addr_t *addr, uint8_t *local_priority)
+{
+    int m = find_master(addr);
+
+    if (m < 0) {
+        return FALSE;
+    }
+    *local_priority = ptp_opts.unicast_masters[m].local_priority;
+    return TRUE;
+}
+
+/**
+ * @brief Get the address to send Delay_Req to.
+ * @param clock A pointer to the PTP clock data structure.
+ * @return The parent's address, or NULL while it has not granted Delay_Resp.
+ */
+const ip_addr_t *unicast_delay_req_destination(ptp_clock_t *clock)
+{
+    int m;
+
+    for (m = 0; m < ptp_opts.num_unicast_masters; ++m) {
+        if (service_wanted(clock, m, SERVICE_DELAY_RESP) && masters[m].service[SERVICE_DELAY_RESP].granted) {
+            return &ptp_opts.unicast_masters[m].address;
+        }
+    }
+    return NULL;
+}
+
+#ifndef PTP_SLAVE_ONLY
+/**
+ * @brief Check whether a slave holds a Delay_Resp grant from us.
+ * @param addr The slave's address (NULL for PTP over Ethernet).
+ */
+bool unicast_delay_resp_granted(const ip_addr_t *addr, int8_t *log_interval)
+{
+    unicast_client_t *client;
+
+    if (addr == NULL) {
+        return FALSE;
+    }
+    client = find_client(addr, FALSE);
+    if (client == NULL || !client->service[SERVICE_DELAY_RESP].granted) {
+        return FALSE;
+    }
+    *log_interval = client->service[SERVICE_DELAY_RESP].log_interval;
+    return TRUE;
+}
+#endif